@@ -0,0 +1,281 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Bvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <Magnum/Math/Functions.h>
+
+namespace Magnum { namespace Examples {
+
+namespace {
+
+constexpr UnsignedInt MaxLeafSize = 4;
+constexpr UnsignedInt BinCount = 16;
+/* Deeper nodes are made leaves regardless of their size, so culling can use
+   a fixed-size stack */
+constexpr UnsignedInt MaxDepth = 48;
+constexpr UnsignedInt NoParent = ~0u;
+
+Float halfArea(const Vector3& min, const Vector3& max) {
+    const Vector3 size = max - min;
+    return size.x()*size.y() + size.y()*size.z() + size.z()*size.x();
+}
+
+}
+
+void Bvh::reset(const std::size_t count) {
+    _spheres.resize(count);
+    _items.clear();
+    _leaves.clear();
+    _moved.clear();
+    _nodes.clear();
+}
+
+bool Bvh::fitNode(const UnsignedInt index) {
+    Node& node = _nodes[index];
+    Vector3 min{std::numeric_limits<Float>::max()};
+    Vector3 max{std::numeric_limits<Float>::lowest()};
+    if(node.left) {
+        const Node& left = _nodes[node.left];
+        const Node& right = _nodes[node.left + 1];
+        min = Math::min(left.min, right.min);
+        max = Math::max(left.max, right.max);
+    } else for(UnsignedInt i = node.first; i != node.first + node.count; ++i) {
+        const Vector4& sphere = _spheres[_items[i]];
+        min = Math::min(min, sphere.xyz() - Vector3{sphere.w()});
+        max = Math::max(max, sphere.xyz() + Vector3{sphere.w()});
+    }
+
+    const bool changed = min != node.min || max != node.max;
+    node.min = min;
+    node.max = max;
+    return changed;
+}
+
+void Bvh::build() {
+    const UnsignedInt count = _spheres.size();
+    _items.resize(count);
+    for(UnsignedInt i = 0; i != count; ++i) _items[i] = i;
+    _leaves.resize(count);
+    _moved.clear();
+    _nodes.clear();
+    if(!count) return;
+
+    /* A binary tree with at least one item per leaf has at most 2n - 1 nodes,
+       reserving them upfront keeps the references below valid */
+    _nodes.reserve(2*count - 1);
+    _nodes.push_back({{}, 0, {}, count, 0, NoParent});
+
+    std::vector<std::pair<UnsignedInt, UnsignedInt>> stack{{0, 0}};
+    while(!stack.empty()) {
+        const UnsignedInt index = stack.back().first;
+        const UnsignedInt depth = stack.back().second;
+        stack.pop_back();
+        fitNode(index);
+        Node& node = _nodes[index];
+
+        /* Bounds of the sphere centres decide the bins */
+        Vector3 centreMin{std::numeric_limits<Float>::max()};
+        Vector3 centreMax{std::numeric_limits<Float>::lowest()};
+        for(UnsignedInt i = node.first; i != node.first + node.count; ++i) {
+            centreMin = Math::min(centreMin, _spheres[_items[i]].xyz());
+            centreMax = Math::max(centreMax, _spheres[_items[i]].xyz());
+        }
+
+        /* Find the cheapest split along any axis. Cost of a split is the
+           sphere count on each side weighted by the box surface. */
+        Float bestCost = std::numeric_limits<Float>::max();
+        Int bestAxis = -1;
+        UnsignedInt bestBin = 0;
+        if(node.count > MaxLeafSize && depth < MaxDepth) for(Int axis = 0; axis != 3; ++axis) {
+            const Float extent = centreMax[axis] - centreMin[axis];
+            if(extent <= 0.0f) continue;
+            const Float scale = BinCount/extent;
+
+            UnsignedInt binCounts[BinCount]{};
+            Vector3 binMin[BinCount], binMax[BinCount];
+            for(UnsignedInt bin = 0; bin != BinCount; ++bin) {
+                binMin[bin] = Vector3{std::numeric_limits<Float>::max()};
+                binMax[bin] = Vector3{std::numeric_limits<Float>::lowest()};
+            }
+            for(UnsignedInt i = node.first; i != node.first + node.count; ++i) {
+                const Vector4& sphere = _spheres[_items[i]];
+                const UnsignedInt bin = Math::min(UnsignedInt((sphere[axis] - centreMin[axis])*scale), BinCount - 1);
+                ++binCounts[bin];
+                binMin[bin] = Math::min(binMin[bin], sphere.xyz() - Vector3{sphere.w()});
+                binMax[bin] = Math::max(binMax[bin], sphere.xyz() + Vector3{sphere.w()});
+            }
+
+            /* Sweep from the right to get cost of the right sides, then from
+               the left to combine them */
+            Float rightCost[BinCount];
+            Vector3 min{std::numeric_limits<Float>::max()};
+            Vector3 max{std::numeric_limits<Float>::lowest()};
+            UnsignedInt rightCount = 0;
+            for(UnsignedInt bin = BinCount - 1; bin != 0; --bin) {
+                rightCount += binCounts[bin];
+                min = Math::min(min, binMin[bin]);
+                max = Math::max(max, binMax[bin]);
+                rightCost[bin] = rightCount ? rightCount*halfArea(min, max) : 0.0f;
+            }
+
+            min = Vector3{std::numeric_limits<Float>::max()};
+            max = Vector3{std::numeric_limits<Float>::lowest()};
+            UnsignedInt leftCount = 0;
+            for(UnsignedInt bin = 0; bin != BinCount - 1; ++bin) {
+                leftCount += binCounts[bin];
+                min = Math::min(min, binMin[bin]);
+                max = Math::max(max, binMax[bin]);
+                if(!leftCount || leftCount == node.count) continue;
+
+                const Float cost = leftCount*halfArea(min, max) + rightCost[bin + 1];
+                if(cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+
+        /* Make a leaf if the split isn't worth it or isn't possible */
+        if(bestAxis == -1 || (node.count <= 2*MaxLeafSize && bestCost >= node.count*halfArea(node.min, node.max))) {
+            for(UnsignedInt i = node.first; i != node.first + node.count; ++i)
+                _leaves[_items[i]] = index;
+            continue;
+        }
+
+        const Float scale = BinCount/(centreMax[bestAxis] - centreMin[bestAxis]);
+        UnsignedInt* const middle = std::partition(_items.data() + node.first, _items.data() + node.first + node.count,
+            [&](UnsignedInt item) {
+                return Math::min(UnsignedInt((_spheres[item][bestAxis] - centreMin[bestAxis])*scale), BinCount - 1) <= bestBin;
+            });
+        const UnsignedInt leftCount = middle - (_items.data() + node.first);
+
+        node.left = _nodes.size();
+        _nodes.push_back({{}, node.first, {}, leftCount, 0, index});
+        _nodes.push_back({{}, node.first + leftCount, {}, node.count - leftCount, 0, index});
+
+        /* Children get fitted when popped, parents are then refitted from
+           them in reverse order below */
+        stack.emplace_back(node.left, depth + 1);
+        stack.emplace_back(node.left + 1, depth + 1);
+    }
+
+    /* Children are always after their parents, so fitting the inner nodes
+       backwards has the children ready. Leaves were fitted already. */
+    for(std::size_t i = _nodes.size(); i != 0; --i)
+        if(_nodes[i - 1].left) fitNode(i - 1);
+}
+
+void Bvh::update(const std::size_t i, const Vector3& centre, const Float radius) {
+    _spheres[i] = {centre, radius};
+    _moved.push_back(i);
+}
+
+void Bvh::refit() {
+    /* Walk up from the leaf of each moved sphere until the boxes stop
+       changing */
+    for(UnsignedInt item: _moved) {
+        for(UnsignedInt node = _leaves[item]; node != NoParent && fitNode(node); node = _nodes[node].parent);
+    }
+
+    _moved.clear();
+}
+
+Float Bvh::cull(const Vector4* const planes, const std::size_t planeCount, const Vector4& depthPlane, Float nearest, const UnsignedInt bit, UnsignedInt* const masks) const {
+    if(_nodes.empty()) return nearest;
+
+    /* Each stack entry carries a mask of planes the node isn't yet known to
+       be fully inside of. Children of a node fully inside a plane don't need
+       to be tested against it again. */
+    struct Entry {
+        UnsignedInt node;
+        UnsignedInt planeMask;
+    };
+    /* A pending right sibling for each level at most, plus the current node.
+       Fixed size, so culling doesn't allocate. */
+    Entry stack[MaxDepth + 1];
+    std::size_t stackSize = 0;
+    stack[stackSize++] = {0, UnsignedInt((1ull << planeCount) - 1)};
+
+    while(stackSize) {
+        const Entry entry = stack[--stackSize];
+        const Node& node = _nodes[entry.node];
+        const Vector3 centre = (node.min + node.max)*0.5f;
+        const Vector3 halfSize = (node.max - node.min)*0.5f;
+
+        UnsignedInt planeMask = entry.planeMask;
+        bool outside = false;
+        for(UnsignedInt mask = planeMask; mask; mask &= mask - 1) {
+            const UnsignedInt p = Math::log2(mask & ~(mask - 1));
+            const Vector4& plane = planes[p];
+            const Float distance = Math::dot(plane.xyz(), centre) + plane.w();
+            const Float radius = Math::dot(Math::abs(plane.xyz()), halfSize);
+            if(distance + radius < 0.0f) {
+                outside = true;
+                break;
+            }
+            if(distance - radius >= 0.0f) planeMask &= ~(1u << p);
+        }
+        if(outside) continue;
+
+        /* Whole subtree is inside or this is a leaf, go through the spheres,
+           testing them only against the planes that are still undecided */
+        if(!planeMask || !node.left) {
+            for(UnsignedInt i = node.first; i != node.first + node.count; ++i) {
+                const UnsignedInt item = _items[i];
+                const Vector4& sphere = _spheres[item];
+
+                bool inside = true;
+                for(UnsignedInt mask = planeMask; mask; mask &= mask - 1) {
+                    const Vector4& plane = planes[Math::log2(mask & ~(mask - 1))];
+                    if(Math::dot(plane.xyz(), sphere.xyz()) + plane.w() + sphere.w() < 0.0f) {
+                        inside = false;
+                        break;
+                    }
+                }
+                if(!inside) continue;
+
+                masks[item] |= bit;
+                nearest = Math::min(nearest, -(Math::dot(depthPlane.xyz(), sphere.xyz()) + depthPlane.w()) - sphere.w());
+            }
+            continue;
+        }
+
+        stack[stackSize++] = {node.left + 1, planeMask};
+        stack[stackSize++] = {node.left, planeMask};
+    }
+
+    return nearest;
+}
+
+}}
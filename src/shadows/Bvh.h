@@ -0,0 +1,118 @@
+#ifndef Magnum_Examples_Bvh_h
+#define Magnum_Examples_Bvh_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <vector>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector4.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Bounding volume hierarchy of bounding spheres
+
+Axis-aligned boxes around groups of spheres, built top-down with the surface
+area heuristic. Culling rejects or accepts whole subtrees at once, so its cost
+scales with the visible part of the scene instead of its size. Moving spheres
+with @ref update() and calling @ref refit() adjusts just the boxes above the
+moved spheres, without changing the tree structure. If the spheres moved a
+lot, it's better to @ref build() the tree again.
+*/
+class Bvh {
+    public:
+        /**
+         * @brief Resize the sphere store
+         *
+         * Contents of the spheres are undefined until @ref set() is called
+         * for each of them. The tree is empty until @ref build() is called.
+         */
+        void reset(std::size_t count);
+
+        /** @brief Sphere count */
+        std::size_t size() const { return _spheres.size(); }
+
+        /** @brief Node count */
+        std::size_t nodeCount() const { return _nodes.size(); }
+
+        /**
+         * @brief Set sphere centre and radius
+         *
+         * Doesn't affect the tree, call @ref build() afterwards.
+         */
+        void set(std::size_t i, const Vector3& centre, Float radius) {
+            _spheres[i] = {centre, radius};
+        }
+
+        /** @brief Build the tree from all spheres */
+        void build();
+
+        /**
+         * @brief Move a sphere
+         *
+         * The tree is adjusted on next @ref refit().
+         */
+        void update(std::size_t i, const Vector3& centre, Float radius);
+
+        /** @brief Adjust the boxes above all spheres moved since last call */
+        void refit();
+
+        /**
+         * @brief Cull the spheres against a set of planes
+         *
+         * Same as @ref SphereCuller::cull(), except that only the subtrees
+         * that intersect the planes are visited. At most 32 planes are
+         * supported.
+         */
+        Float cull(const Vector4* planes, std::size_t planeCount, const Vector4& depthPlane, Float nearest, UnsignedInt bit, UnsignedInt* masks) const;
+
+    private:
+        struct Node {
+            Vector3 min;
+            /* Offset and count of the spheres in the subtree, in _items */
+            UnsignedInt first;
+            Vector3 max;
+            UnsignedInt count;
+            /* Index of the left child, the right one is right after it. Zero
+               for leaves as the root is never a child. */
+            UnsignedInt left;
+            UnsignedInt parent;
+        };
+
+        bool fitNode(UnsignedInt node);
+
+        std::vector<Vector4> _spheres;
+        std::vector<UnsignedInt> _items, _leaves, _moved;
+        std::vector<Node> _nodes;
+};
+
+}}
+
+#endif
@@ -0,0 +1,362 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CasterCuller.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/Context.h>
+#include <Magnum/OpenGL.h>
+#include <Magnum/Shader.h>
+#include <Magnum/Version.h>
+#include <Magnum/SceneGraph/Drawable.h>
+#include <Magnum/SceneGraph/FeatureGroup.h>
+
+namespace Magnum { namespace Examples {
+
+namespace {
+
+/* Max work group count in one dimension guaranteed by the spec */
+constexpr const std::size_t MaxWorkGroups = 65535;
+constexpr const std::size_t WorkGroupSize = 64;
+
+bool instanceLess(const ShadowCasterBatcher::Instance& a, const ShadowCasterBatcher::Instance& b) {
+    return std::memcmp(&a, &b, sizeof(ShadowCasterBatcher::Instance)) < 0;
+}
+
+}
+
+CasterCuller::Shader::Shader(const Stage stage) {
+    MAGNUM_ASSERT_VERSION_SUPPORTED(Version::GL430);
+
+    const Utility::Resource rs{"shadow-data"};
+
+    Magnum::Shader comp{Version::GL430, Magnum::Shader::Type::Compute};
+
+    comp.addSource(std::string{"#define "} +
+        (stage == Stage::Count ? "COUNT" : stage == Stage::Commands ? "COMMANDS" : "SCATTER") +
+        "\n#define MAX_LAYERS " + std::to_string(MaxLayers) + "\n");
+    comp.addSource(rs.get("CasterCulling.comp"));
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(comp.compile());
+
+    attachShader(comp);
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    _layerCountUniform = uniformLocation("layerCount");
+    _meshCountUniform = uniformLocation("meshCount");
+    if(stage == Stage::Commands) {
+        _casterOffsetUniform = _casterCountUniform = _layerPlanesUniform = _layerTexelsPerUnitUniform = -1;
+    } else {
+        _casterOffsetUniform = uniformLocation("casterOffset");
+        _casterCountUniform = uniformLocation("casterCount");
+        _layerPlanesUniform = uniformLocation("layerPlanes");
+        _layerTexelsPerUnitUniform = uniformLocation("layerTexelsPerUnit");
+    }
+}
+
+CasterCuller::Shader& CasterCuller::Shader::setLayers(const Containers::ArrayView<const Vector4> planes, const Containers::ArrayView<const Float> texelsPerUnit) {
+    setUniform(_layerCountUniform, UnsignedInt(texelsPerUnit.size()));
+    if(_layerPlanesUniform != -1) {
+        setUniform(_layerPlanesUniform, planes);
+        setUniform(_layerTexelsPerUnitUniform, texelsPerUnit);
+    }
+    return *this;
+}
+
+CasterCuller::Shader& CasterCuller::Shader::setCasters(const UnsignedInt offset, const UnsignedInt count) {
+    setUniform(_casterOffsetUniform, offset);
+    setUniform(_casterCountUniform, count);
+    return *this;
+}
+
+CasterCuller::Shader& CasterCuller::Shader::setMeshCount(const UnsignedInt count) {
+    setUniform(_meshCountUniform, count);
+    return *this;
+}
+
+bool CasterCuller::isComputeSupported() {
+    return Context::current().isVersionSupported(Version::GL430);
+}
+
+CasterCuller::CasterCuller(ShadowCasterBatcher& batcher): _batcher(batcher), _computeEnabled{isComputeSupported()} {
+    if(_computeEnabled) {
+        _countShader.reset(new Shader{Shader::Stage::Count});
+        _commandsShader.reset(new Shader{Shader::Stage::Commands});
+        _scatterShader.reset(new Shader{Shader::Stage::Scatter});
+    }
+}
+
+void CasterCuller::setComputeEnabled(const bool enabled) {
+    _computeEnabled = enabled && _countShader;
+
+    /* The buffers weren't updated while on the CPU path */
+    _uploadAll = true;
+    _batchCount = 0;
+}
+
+UnsignedInt CasterCuller::lodChain(Mesh& mesh, const Containers::ArrayView<const ShadowCasterLod> lods) {
+    const auto found = _lodChains.find({&mesh, lods.data()});
+    if(found != _lodChains.end()) return found->second;
+
+    const UnsignedInt offset = _lodData.size();
+    _lodData.push_back(lods.size());
+    _lodData.push_back(_batcher.meshId(mesh));
+    for(const ShadowCasterLod& lod: lods) {
+        UnsignedInt maxTexels;
+        std::memcpy(&maxTexels, &lod.maxTexels, sizeof(Float));
+        _lodData.push_back(_batcher.meshId(*lod.mesh));
+        _lodData.push_back(maxTexels);
+    }
+
+    _lodChains.emplace(std::make_pair(&mesh, lods.data()), offset);
+    return offset;
+}
+
+void CasterCuller::setCasters(SceneGraph::DrawableGroup3D& drawables, const Containers::ArrayView<const Matrix4> transformations, const Containers::ArrayView<const UnsignedInt> movedCasters, const bool casterSetChanged) {
+    CORRADE_INTERNAL_ASSERT(transformations.size() == drawables.size());
+    _transformations = transformations;
+
+    /* Casters sharing the same meshes share the chain */
+    if(casterSetChanged || _spheres.size() != drawables.size()) {
+        _spheres.resize(drawables.size());
+        _casterLods.resize(drawables.size());
+        _lodData.clear();
+        _lodChains.clear();
+        for(std::size_t i = 0; i != drawables.size(); ++i) {
+            auto& drawable = static_cast<ShadowCasterDrawable&>(drawables[i]);
+            _spheres[i] = {transformations[i].translation(), drawable.radius()};
+            _casterLods[i] = lodChain(drawable.mesh(), drawable.lods());
+        }
+        _uploadAll = true;
+
+    } else for(const UnsignedInt i: movedCasters)
+        _spheres[i].xyz() = transformations[i].translation();
+
+    if(!_computeEnabled) return;
+
+    if(_uploadAll) {
+        _casterLodBuffer.setData(_casterLods, BufferUsage::StaticDraw);
+        _lodBuffer.setData(_lodData, BufferUsage::StaticDraw);
+    }
+    if(_uploadAll || !movedCasters.empty()) {
+        _sphereBuffer.setData(_spheres, BufferUsage::DynamicDraw);
+        _transformationBuffer.setData(_transformations, BufferUsage::DynamicDraw);
+    }
+    _uploadAll = false;
+}
+
+void CasterCuller::cull(const Containers::ArrayView<const Vector4> layerPlanes, const Containers::ArrayView<const Float> layerTexelsPerUnit) {
+    CORRADE_INTERNAL_ASSERT(layerTexelsPerUnit.size() <= MaxLayers && layerPlanes.size() == layerTexelsPerUnit.size()*5);
+    _layerPlanes.assign(layerPlanes.begin(), layerPlanes.end());
+    _layerTexelsPerUnit.assign(layerTexelsPerUnit.begin(), layerTexelsPerUnit.end());
+    _drawCount = 0;
+
+    if(_computeEnabled) {
+        cullOnGpu();
+        return;
+    }
+
+    cullOnCpu(_commands, _instances);
+    _commandBuffer.setData(_commands, BufferUsage::StreamDraw);
+    _batcher.instanceBuffer().setData(_instances, BufferUsage::StreamDraw);
+}
+
+void CasterCuller::cullOnCpu(std::vector<ShadowCasterBatcher::DrawCommand>& commands, std::vector<ShadowCasterBatcher::Instance>& instances) const {
+    const std::size_t meshCount = _batcher.meshCount();
+    const std::size_t layerCount = _layerTexelsPerUnit.size();
+
+    /* Same as casterMesh() in CasterCulling.comp, including the order of
+       the floating-point operations */
+    auto casterMesh = [&](const std::size_t caster, const std::size_t layer) -> UnsignedInt {
+        const Vector4& sphere = _spheres[caster];
+        for(std::size_t p = 0; p != 5; ++p) {
+            const Vector4& plane = _layerPlanes[layer*5 + p];
+            Float distance = sphere.x()*plane.x() + plane.w();
+            distance = distance + sphere.y()*plane.y();
+            distance = distance + sphere.z()*plane.z();
+            if(!(distance + sphere.w() >= 0.0f)) return ~0u;
+        }
+
+        const Float texels = 2.0f*sphere.w()*_layerTexelsPerUnit[layer];
+        const UnsignedInt chain = _casterLods[caster];
+        for(UnsignedInt i = _lodData[chain]; i != 0; --i) {
+            Float maxTexels;
+            std::memcpy(&maxTexels, &_lodData[chain + 2*i + 1], sizeof(Float));
+            if(texels <= maxTexels) return _lodData[chain + 2*i];
+        }
+        return _lodData[chain + 1];
+    };
+
+    /* Count the instances of each layer and mesh combination */
+    commands.resize(layerCount*meshCount);
+    for(std::size_t batch = 0; batch != commands.size(); ++batch) {
+        const MeshPool::Range& range = _batcher.meshRange(batch%meshCount);
+        commands[batch] = {range.indexCount, 0, range.indexOffset, range.baseVertex, 0};
+    }
+    for(std::size_t caster = 0; caster != _spheres.size(); ++caster) {
+        for(std::size_t layer = 0; layer != layerCount; ++layer) {
+            const UnsignedInt mesh = casterMesh(caster, layer);
+            if(mesh != ~0u) ++commands[layer*meshCount + mesh].instanceCount;
+        }
+    }
+
+    /* Turn the counts into offsets */
+    UnsignedInt offset = 0;
+    for(ShadowCasterBatcher::DrawCommand& command: commands) {
+        command.baseInstance = offset;
+        offset += command.instanceCount;
+        command.instanceCount = 0;
+    }
+
+    /* Scatter the instances */
+    instances.resize(offset);
+    for(std::size_t caster = 0; caster != _spheres.size(); ++caster) {
+        for(std::size_t layer = 0; layer != layerCount; ++layer) {
+            const UnsignedInt mesh = casterMesh(caster, layer);
+            if(mesh == ~0u) continue;
+            ShadowCasterBatcher::DrawCommand& command = commands[layer*meshCount + mesh];
+            instances[command.baseInstance + command.instanceCount++] = {_transformations[caster], 1u << layer};
+        }
+    }
+}
+
+void CasterCuller::cullOnGpu() {
+    const std::size_t meshCount = _batcher.meshCount();
+    const std::size_t batchCount = _layerTexelsPerUnit.size()*meshCount;
+    const std::size_t casterCount = _spheres.size();
+
+    /* The counters are cleared by the commands stage, so they need to be
+       zero only initially */
+    if(batchCount != _batchCount) {
+        _countBuffer.setData(std::vector<UnsignedInt>(batchCount, 0), BufferUsage::DynamicCopy);
+        _commandBuffer.setData({nullptr, batchCount*sizeof(ShadowCasterBatcher::DrawCommand)}, BufferUsage::DynamicCopy);
+
+        std::vector<UnsignedInt> meshRanges;
+        for(UnsignedInt mesh = 0; mesh != meshCount; ++mesh) {
+            const MeshPool::Range& range = _batcher.meshRange(mesh);
+            meshRanges.insert(meshRanges.end(), {range.indexOffset, range.indexCount, UnsignedInt(range.baseVertex), 0});
+        }
+        _meshRangeBuffer.setData(meshRanges, BufferUsage::StaticDraw);
+        _batchCount = batchCount;
+    }
+
+    /* Worst case is every caster in every layer */
+    Buffer& instanceBuffer = _batcher.instanceBuffer();
+    const std::size_t instanceCapacity = Math::max(casterCount*_layerTexelsPerUnit.size(), std::size_t(1))*sizeof(ShadowCasterBatcher::Instance);
+    if(std::size_t(instanceBuffer.size()) < instanceCapacity)
+        instanceBuffer.setData({nullptr, instanceCapacity}, BufferUsage::DynamicCopy);
+
+    for(Shader* shader: {_countShader.get(), _commandsShader.get(), _scatterShader.get()})
+        shader->setLayers({_layerPlanes.data(), _layerPlanes.size()}, {_layerTexelsPerUnit.data(), _layerTexelsPerUnit.size()})
+            .setMeshCount(meshCount);
+
+    /* Magnum has no compute dispatch, so bind the buffers and programs
+       directly and let Magnum know its state is stale */
+    const GLuint buffers[]{_sphereBuffer.id(), _casterLodBuffer.id(), _lodBuffer.id(),
+        _countBuffer.id(), _commandBuffer.id(), _meshRangeBuffer.id(),
+        _transformationBuffer.id(), instanceBuffer.id()};
+    for(GLuint i = 0; i != 8; ++i)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffers[i]);
+
+    auto dispatchCasters = [&](Shader& shader) {
+        for(std::size_t offset = 0; offset < casterCount; offset += MaxWorkGroups*WorkGroupSize) {
+            shader.setCasters(offset, casterCount);
+            glUseProgram(shader.id());
+            glDispatchCompute(Math::min((casterCount - offset + WorkGroupSize - 1)/WorkGroupSize, MaxWorkGroups), 1, 1);
+        }
+    };
+
+    dispatchCasters(*_countShader);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(_commandsShader->id());
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    dispatchCasters(*_scatterShader);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT|GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    Context::current().resetState(Context::State::Buffers|Context::State::Shaders);
+}
+
+void CasterCuller::draw(const UnsignedInt layer, const Matrix4& transformationProjectionMatrix) {
+    const std::size_t meshCount = _batcher.meshCount();
+    _batcher.drawIndirect(_commandBuffer, layer*meshCount, meshCount, transformationProjectionMatrix);
+    ++_drawCount;
+}
+
+bool CasterCuller::verify() {
+    if(!_computeEnabled) return true;
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    const Containers::Array<ShadowCasterBatcher::DrawCommand> gpuCommands = _commandBuffer.data<ShadowCasterBatcher::DrawCommand>();
+    Containers::Array<ShadowCasterBatcher::Instance> gpuInstances = _batcher.instanceBuffer().data<ShadowCasterBatcher::Instance>();
+
+    cullOnCpu(_commands, _instances);
+    CORRADE_INTERNAL_ASSERT(gpuCommands.size() >= _commands.size());
+
+    for(std::size_t batch = 0; batch != _commands.size(); ++batch) {
+        const ShadowCasterBatcher::DrawCommand& expected = _commands[batch];
+        const ShadowCasterBatcher::DrawCommand& actual = gpuCommands[batch];
+        if(std::memcmp(&expected, &actual, sizeof(ShadowCasterBatcher::DrawCommand)) != 0) {
+            Error() << "CasterCuller::verify(): command" << batch << "is" << actual.count
+                << actual.instanceCount << actual.firstIndex << actual.baseVertex
+                << actual.baseInstance << "but expected" << expected.count
+                << expected.instanceCount << expected.firstIndex
+                << expected.baseVertex << expected.baseInstance;
+            return false;
+        }
+
+        /* The GPU writes the instances of a command in arbitrary order */
+        ShadowCasterBatcher::Instance* const expectedInstances = _instances.data() + expected.baseInstance;
+        ShadowCasterBatcher::Instance* const actualInstances = gpuInstances.data() + actual.baseInstance;
+        std::sort(expectedInstances, expectedInstances + expected.instanceCount, instanceLess);
+        std::sort(actualInstances, actualInstances + actual.instanceCount, instanceLess);
+        for(UnsignedInt i = 0; i != expected.instanceCount; ++i) {
+            if(std::memcmp(expectedInstances + i, actualInstances + i, sizeof(ShadowCasterBatcher::Instance)) != 0) {
+                Error() << "CasterCuller::verify(): instance" << i << "of command"
+                    << batch << "is" << actualInstances[i].transformationMatrix
+                    << actualInstances[i].cascadeMask << "but expected"
+                    << expectedInstances[i].transformationMatrix
+                    << expectedInstances[i].cascadeMask;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+}}
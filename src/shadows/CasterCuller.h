@@ -0,0 +1,180 @@
+#ifndef Magnum_Examples_CasterCuller_h
+#define Magnum_Examples_CasterCuller_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/Buffer.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/SceneGraph/SceneGraph.h>
+
+#include "ShadowCasterBatcher.h"
+#include "ShadowCasterDrawable.h"
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief GPU-driven shadow caster culling
+
+Keeps bounding spheres, transformations and level-of-detail chains of all
+casters in shader storage buffers. A compute shader culls them against the
+planes of every layer in one dispatch and writes indirect draw commands and
+instances straight into buffers consumed by
+@ref ShadowCasterBatcher::drawIndirect(), so nothing is read back to the CPU.
+Needs OpenGL 4.3; without it, or with @ref setComputeEnabled() set to
+@cpp false @ce, the same commands and instances are generated on the CPU and
+uploaded.
+
+Both paths produce bit-identical commands and the same instances in each
+command, only the order of instances inside a command may differ on the GPU.
+Use @ref verify() to check that.
+
+All meshes of the casters have to be registered in the batcher and pooled,
+with @ref ShadowCasterBatcher::multiDrawMesh() set.
+*/
+class CasterCuller {
+    public:
+        /** @brief Max layer count */
+        enum: UnsignedInt { MaxLayers = 32 };
+
+        /** @brief Whether the compute path is supported by the driver */
+        static bool isComputeSupported();
+
+        explicit CasterCuller(ShadowCasterBatcher& batcher);
+
+        /**
+         * @brief Use the compute shader path
+         *
+         * Enabled by default if supported, can't be enabled otherwise.
+         */
+        void setComputeEnabled(bool enabled);
+
+        bool isComputeEnabled() const { return _computeEnabled; }
+
+        /**
+         * @brief Update the casters
+         * @param drawables         Caster drawables
+         * @param transformations   World transformation of each caster
+         * @param movedCasters      Indices of casters that moved since the
+         *      last call
+         * @param casterSetChanged  Whether casters were added or removed
+         *
+         * Level of detail chains are recalculated only if the caster set
+         * changed. The spheres and transformations are uploaded again if any
+         * of them changed. The @p transformations are expected to stay valid
+         * until the next call.
+         */
+        void setCasters(SceneGraph::DrawableGroup3D& drawables, Containers::ArrayView<const Matrix4> transformations, Containers::ArrayView<const UnsignedInt> movedCasters, bool casterSetChanged);
+
+        /**
+         * @brief Cull the casters and generate draw commands
+         * @param layerPlanes       Five clip planes of each layer, positive
+         *      side is inside. The near plane should be omitted, casters in
+         *      front of it are expected to be clamped to it.
+         * @param layerTexelsPerUnit Shadow map texels per world unit in each
+         *      layer, used to pick the level of detail
+         */
+        void cull(Containers::ArrayView<const Vector4> layerPlanes, Containers::ArrayView<const Float> layerTexelsPerUnit);
+
+        /**
+         * @brief Draw casters of given layer
+         *
+         * Issues one multi-draw call.
+         */
+        void draw(UnsignedInt layer, const Matrix4& transformationProjectionMatrix);
+
+        /**
+         * @brief Verify the compute path against the CPU path
+         *
+         * Reads back the output of the last @ref cull() done with the compute
+         * shader, which stalls the pipeline, generates the output again on
+         * the CPU and compares them. Prints the first difference and returns
+         * @cpp false @ce if they don't match. If the compute path is disabled,
+         * returns @cpp true @ce.
+         */
+        bool verify();
+
+        /** @brief Count of draw calls issued since last @ref cull() */
+        UnsignedInt drawCount() const { return _drawCount; }
+
+    private:
+        class Shader: public AbstractShaderProgram {
+            public:
+                enum class Stage { Count, Commands, Scatter };
+
+                explicit Shader(Stage stage);
+
+                Shader& setLayers(Containers::ArrayView<const Vector4> planes, Containers::ArrayView<const Float> texelsPerUnit);
+                Shader& setCasters(UnsignedInt offset, UnsignedInt count);
+                Shader& setMeshCount(UnsignedInt count);
+
+            private:
+                Int _layerCountUniform,
+                    _meshCountUniform,
+                    _casterOffsetUniform,
+                    _casterCountUniform,
+                    _layerPlanesUniform,
+                    _layerTexelsPerUnitUniform;
+        };
+
+        UnsignedInt lodChain(Mesh& mesh, Containers::ArrayView<const ShadowCasterLod> lods);
+        void cullOnCpu(std::vector<ShadowCasterBatcher::DrawCommand>& commands, std::vector<ShadowCasterBatcher::Instance>& instances) const;
+        void cullOnGpu();
+
+        ShadowCasterBatcher& _batcher;
+        bool _computeEnabled, _uploadAll{true};
+        std::unique_ptr<Shader> _countShader, _commandsShader, _scatterShader;
+        Buffer _sphereBuffer, _casterLodBuffer, _lodBuffer, _countBuffer,
+            _commandBuffer, _meshRangeBuffer, _transformationBuffer;
+
+        std::vector<Vector4> _spheres;
+        std::vector<UnsignedInt> _casterLods, _lodData;
+        std::map<std::pair<Mesh*, const ShadowCasterLod*>, UnsignedInt> _lodChains;
+        Containers::ArrayView<const Matrix4> _transformations;
+
+        /* Inputs of the last cull() */
+        std::vector<Vector4> _layerPlanes;
+        std::vector<Float> _layerTexelsPerUnit;
+        std::size_t _batchCount{};
+
+        /* CPU path output */
+        std::vector<ShadowCasterBatcher::DrawCommand> _commands;
+        std::vector<ShadowCasterBatcher::Instance> _instances;
+
+        UnsignedInt _drawCount{};
+};
+
+}}
+
+#endif
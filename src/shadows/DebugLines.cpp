@@ -30,6 +30,10 @@
 
 #include "DebugLines.h"
 
+#include <cstring>
+#include <Magnum/Context.h>
+#include <Magnum/Extensions.h>
+#include <Magnum/OpenGL.h>
 #include <Magnum/SceneGraph/Camera.h>
 #include <Magnum/Renderer.h>
 
@@ -37,23 +41,108 @@
 
 namespace Magnum { namespace Examples {
 
-DebugLines::DebugLines(): _mesh{MeshPrimitive::Lines} {
+namespace {
+
+void waitForFence(void*& fence) {
+    if(!fence) return;
+
+    /* Flush on the first wait, otherwise the fence might never get
+       signaled */
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while(glClientWaitSync(static_cast<GLsync>(fence), flags, 1000000) == GL_TIMEOUT_EXPIRED)
+        flags = 0;
+    glDeleteSync(static_cast<GLsync>(fence));
+    fence = nullptr;
+}
+
+}
+
+DebugLines::DebugLines(const std::size_t capacity): _mesh{MeshPrimitive::Lines}, _persistent{Context::current().isExtensionSupported<Extensions::GL::ARB::buffer_storage>()} {
+    allocate(capacity);
+    if(!_persistent)
+        _mesh.addVertexBuffer(_buffer, 0, Shader::Position(), Shader::Color());
+}
+
+DebugLines::~DebugLines() {
+    for(void*& fence: _fences)
+        if(fence) glDeleteSync(static_cast<GLsync>(fence));
+}
+
+void DebugLines::allocate(const std::size_t capacity) {
+    _capacity = capacity;
+
+    if(!_persistent) {
+        _lines.resize(capacity);
+        _points = _lines.data();
+        return;
+    }
+
+    /* Immutable storage can't be resized, so a bigger buffer needs a new
+       mesh as well. The pending fences are dropped without waiting and the
+       old buffer is deleted right away, GL keeps its storage alive until
+       the draws still using it are done. */
+    for(void*& fence: _fences)
+        if(fence) {
+            glDeleteSync(static_cast<GLsync>(fence));
+            fence = nullptr;
+        }
+    const std::size_t size = SegmentCount*capacity*sizeof(Point);
+    _buffer = Buffer{};
+    _buffer.setStorage({nullptr, size}, Buffer::StorageFlag::MapWrite|Buffer::StorageFlag::MapPersistent|Buffer::StorageFlag::MapCoherent);
+    _mapped = reinterpret_cast<Point*>(_buffer.map(0, size, Buffer::MapFlag::Write|Buffer::MapFlag::Persistent|Buffer::MapFlag::Coherent));
+    _segment = 0;
+    _points = _mapped;
+
+    _mesh = Mesh{MeshPrimitive::Lines};
     _mesh.addVertexBuffer(_buffer, 0, Shader::Position(), Shader::Color());
 }
 
+void DebugLines::grow(const std::size_t count) {
+    const std::size_t capacity = Math::max(count, 2*_capacity);
+    if(!_persistent) {
+        _capacity = capacity;
+        _lines.resize(capacity);
+        _points = _lines.data();
+        return;
+    }
+
+    /* Keep what was written in this frame so far */
+    std::vector<Point> points{_points, _points + _count};
+    allocate(capacity);
+    std::memcpy(_points, points.data(), points.size()*sizeof(Point));
+}
+
 void DebugLines::reset() {
-    _lines.clear();
-    _buffer.invalidateData();
+    _count = 0;
+    if(!_persistent) return;
+
+    /* Move to the next segment once the GPU is done drawing from it */
+    _segment = (_segment + 1) % SegmentCount;
+    waitForFence(_fences[_segment]);
+    _points = _mapped + _segment*_capacity;
 }
 
 void DebugLines::draw(const Matrix4& transformationProjectionMatrix) {
-    if(!_lines.empty()) {
-        Renderer::disable(Renderer::Feature::DepthTest);
-        _buffer.setData(_lines, BufferUsage::StreamDraw);
-        _mesh.setCount(_lines.size());
-        _shader.setTransformationProjectionMatrix(transformationProjectionMatrix);
-        _mesh.draw(_shader);
-        Renderer::enable(Renderer::Feature::DepthTest);
+    if(!_count) return;
+
+    if(_persistent) {
+        /* For non-indexed meshes the base vertex is the first vertex */
+        _mesh.setBaseVertex(_segment*_capacity);
+    } else {
+        _buffer.setData({_lines.data(), _count*sizeof(Point)}, BufferUsage::StreamDraw);
+        _mesh.setBaseVertex(0);
+    }
+
+    Renderer::disable(Renderer::Feature::DepthTest);
+    _mesh.setCount(_count);
+    _shader.setTransformationProjectionMatrix(transformationProjectionMatrix);
+    _mesh.draw(_shader);
+    Renderer::enable(Renderer::Feature::DepthTest);
+
+    /* Drawing the same segment more than once needs just the last fence */
+    if(_persistent) {
+        if(_fences[_segment]) glDeleteSync(static_cast<GLsync>(_fences[_segment]));
+        _fences[_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
     }
 }
 
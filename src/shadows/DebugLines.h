@@ -30,6 +30,7 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <vector>
 #include <Magnum/Buffer.h>
 #include <Magnum/Mesh.h>
 #include <Magnum/SceneGraph/SceneGraph.h>
@@ -37,6 +38,18 @@
 
 namespace Magnum { namespace Examples {
 
+/**
+@brief Debug line renderer
+
+If @extension{ARB,buffer_storage} is available, the lines are written
+directly into a persistently mapped buffer split into three segments used
+in turn, so the GPU can still draw one frame while the next is being filled.
+Before a segment is reused, a fence makes sure the GPU finished drawing from
+it. When a frame doesn't fit into a segment, the buffer is reallocated with
+twice the size, so after a few frames no more allocations happen. Without
+the extension the lines are collected in a client-side array and uploaded
+in @ref draw().
+*/
 class DebugLines {
     public:
         typedef Shaders::VertexColor3D Shader;
@@ -46,13 +59,38 @@ class DebugLines {
             Color3 color;
         };
 
-        explicit DebugLines();
+        enum: UnsignedInt {
+            /** Count of frames in flight */
+            SegmentCount = 3
+        };
+
+        /**
+         * @brief Constructor
+         * @param capacity      Initial count of points in a frame
+         */
+        explicit DebugLines(std::size_t capacity = 4096);
+
+        /** @brief Copying is not allowed */
+        DebugLines(const DebugLines&) = delete;
+
+        ~DebugLines();
+
+        /** @brief Copying is not allowed */
+        DebugLines& operator=(const DebugLines&) = delete;
+
+        /** @brief Whether the lines are written to a persistently mapped buffer */
+        bool isPersistent() const { return _persistent; }
 
+        /** @brief Count of points that fit in a frame without reallocation */
+        std::size_t capacity() const { return _capacity; }
+
+        /** @brief Start a new frame */
         void reset();
 
         void addLine(const Point& p0, const Point& p1) {
-            _lines.push_back(p0);
-            _lines.push_back(p1);
+            if(_count + 2 > _capacity) grow(_count + 2);
+            _points[_count++] = p0;
+            _points[_count++] = p1;
         }
 
         void addLine(const Vector3& p0, const Vector3& p1, const Color3& col) {
@@ -64,11 +102,27 @@ class DebugLines {
 
         void draw(const Matrix4& transformationProjectionMatrix);
 
-    protected:
-        std::vector<Point> _lines;
+    private:
+        void grow(std::size_t count);
+        void allocate(std::size_t capacity);
+
         Buffer _buffer;
         Mesh _mesh;
         Shader _shader;
+        bool _persistent;
+
+        /* Points of current frame, either in the mapped segment or in the
+           client-side array */
+        Point* _points{};
+        std::size_t _count{}, _capacity{};
+
+        /* Persistent mapping, _fences are GLsync */
+        Point* _mapped{};
+        UnsignedInt _segment{};
+        void* _fences[SegmentCount]{};
+
+        /* Fallback */
+        std::vector<Point> _lines;
 };
 
 }}
@@ -0,0 +1,146 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DepthReduction.h"
+
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/Buffer.h>
+#include <Magnum/Context.h>
+#include <Magnum/DefaultFramebuffer.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/RenderbufferFormat.h>
+#include <Magnum/Shader.h>
+#include <Magnum/TextureFormat.h>
+#include <Magnum/Version.h>
+
+namespace Magnum { namespace Examples {
+
+namespace {
+
+/* Each reduction pass shrinks the input four times in each direction */
+constexpr Int ReductionFactor = 4;
+
+}
+
+DepthReduction::Shader::Shader() {
+    MAGNUM_ASSERT_VERSION_SUPPORTED(Version::GL330);
+
+    const Utility::Resource rs{"shadow-data"};
+
+    Magnum::Shader vert{Version::GL330, Magnum::Shader::Type::Vertex};
+    Magnum::Shader frag{Version::GL330, Magnum::Shader::Type::Fragment};
+
+    vert.addSource(rs.get("FullscreenTriangle.vert"));
+    frag.addSource(rs.get("DepthReduction.frag"));
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(Magnum::Shader::compile({vert, frag}));
+
+    attachShaders({vert, frag});
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    _inputIsDepthUniform = uniformLocation("inputIsDepth");
+
+    setUniform(uniformLocation("inputTexture"), 0);
+}
+
+DepthReduction::Shader& DepthReduction::Shader::setInputTexture(Texture2D& texture, const bool isDepth) {
+    texture.bind(0);
+    setUniform(_inputIsDepthUniform, Int(isDepth));
+    return *this;
+}
+
+DepthReduction::Level::Level(const Vector2i& size): framebuffer{{{}, size}} {
+    texture.setStorage(1, TextureFormat::RG32F, size)
+        .setMinificationFilter(Sampler::Filter::Nearest)
+        .setMagnificationFilter(Sampler::Filter::Nearest);
+    framebuffer.attachTexture(Framebuffer::ColorAttachment{0}, texture, 0);
+    CORRADE_INTERNAL_ASSERT(framebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+}
+
+DepthReduction::DepthReduction(): _framebuffer{NoCreate} {
+    /* The vertex shader generates the positions from vertex ID */
+    _fullscreenTriangle.setPrimitive(MeshPrimitive::Triangles)
+        .setCount(3);
+
+    _readback.emplace_back(PixelFormat::RG, PixelType::Float);
+    _readback.emplace_back(PixelFormat::RG, PixelType::Float);
+}
+
+void DepthReduction::setup(const Vector2i& size) {
+    (_depth = Texture2D{})
+        .setStorage(1, TextureFormat::DepthComponent32F, size)
+        .setMinificationFilter(Sampler::Filter::Nearest)
+        .setMagnificationFilter(Sampler::Filter::Nearest);
+    (_color = Renderbuffer{})
+        .setStorage(RenderbufferFormat::RGBA8, size);
+
+    (_framebuffer = Framebuffer{{{}, size}})
+        .attachTexture(Framebuffer::BufferAttachment::Depth, _depth, 0)
+        .attachRenderbuffer(Framebuffer::ColorAttachment{0}, _color);
+    CORRADE_INTERNAL_ASSERT(_framebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+
+    /* Reduce until a single texel is left */
+    _levels.clear();
+    Vector2i levelSize = size;
+    do {
+        levelSize = (levelSize + Vector2i{ReductionFactor - 1})/ReductionFactor;
+        _levels.emplace_back(levelSize);
+    } while(levelSize != Vector2i{1});
+
+    _depthRange = {0.0f, 1.0f};
+}
+
+void DepthReduction::reduce() {
+    /* Pick up the result of the previous frame, it should be ready by now */
+    BufferImage2D& previous = _readback[(_frame + 1) % 2];
+    if(previous.size() == Vector2i{1}) {
+        const Containers::Array<Vector2> data = previous.buffer().data<Vector2>();
+        /* Empty view has min > max, use the full range then */
+        _depthRange = data[0].x() <= data[0].y() ? data[0] : Vector2{0.0f, 1.0f};
+    }
+
+    Texture2D* input = &_depth;
+    for(Level& level: _levels) {
+        level.framebuffer.bind();
+        _shader.setInputTexture(*input, input == &_depth);
+        _fullscreenTriangle.draw(_shader);
+        input = &level.texture;
+    }
+
+    /* Queue the readback for the next frame */
+    _levels.back().texture.image(0, _readback[_frame % 2], BufferUsage::StreamRead);
+    ++_frame;
+
+    defaultFramebuffer.bind();
+}
+
+}}
@@ -0,0 +1,62 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Either a depth texture or a previous reduction level */
+uniform highp sampler2D inputTexture;
+uniform int inputIsDepth;
+
+out highp vec2 range;
+
+/* Has to match ReductionFactor in DepthReduction.cpp */
+#define REDUCTION_FACTOR 4
+
+void main() {
+    ivec2 inputSize = textureSize(inputTexture, 0);
+    ivec2 base = ivec2(gl_FragCoord.xy)*REDUCTION_FACTOR;
+
+    /* Min > max marks an empty range */
+    highp vec2 result = vec2(1.0, 0.0);
+    for(int y = 0; y < REDUCTION_FACTOR; ++y) {
+        for(int x = 0; x < REDUCTION_FACTOR; ++x) {
+            ivec2 coords = base + ivec2(x, y);
+            if(any(greaterThanEqual(coords, inputSize)))
+                continue;
+
+            highp vec4 value = texelFetch(inputTexture, coords, 0);
+            if(inputIsDepth != 0) {
+                /* The background would always max out the range */
+                if(value.r == 1.0) continue;
+                result = vec2(min(result.x, value.r), max(result.y, value.r));
+            } else result = vec2(min(result.x, value.r), max(result.y, value.g));
+        }
+    }
+
+    range = result;
+}
@@ -0,0 +1,114 @@
+#ifndef Magnum_Examples_DepthReduction_h
+#define Magnum_Examples_DepthReduction_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/BufferImage.h>
+#include <Magnum/Framebuffer.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Renderbuffer.h>
+#include <Magnum/Texture.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Depth buffer min/max reduction
+
+Provides a framebuffer with a depth texture to render the main view into,
+reduces the depth to a min/max range on the GPU and reads it back with one
+frame delay so the pipeline doesn't stall. Used to place the shadow cascade
+splits only along the depth range the scene actually occupies.
+*/
+class DepthReduction {
+    public:
+        explicit DepthReduction();
+
+        /**
+         * @brief Set up the framebuffer and reduction chain
+         *
+         * Resets the depth range to the full range.
+         */
+        void setup(const Vector2i& size);
+
+        /** @brief Framebuffer to render the view into */
+        Framebuffer& framebuffer() { return _framebuffer; }
+
+        /**
+         * @brief Reduce the depth buffer
+         *
+         * Call after the view has been rendered into @ref framebuffer(). The
+         * result is available in @ref depthRange() after the next call.
+         */
+        void reduce();
+
+        /**
+         * @brief Minimal and maximal window-space depth of the last read back frame
+         *
+         * Samples at the far plane (i.e., background) are ignored. If the
+         * view contains no geometry, returns full range.
+         */
+        Vector2 depthRange() const { return _depthRange; }
+
+    private:
+        class Shader: public AbstractShaderProgram {
+            public:
+                explicit Shader();
+
+                Shader& setInputTexture(Texture2D& texture, bool isDepth);
+
+            private:
+                Int _inputIsDepthUniform;
+        };
+
+        struct Level {
+            Texture2D texture;
+            Framebuffer framebuffer;
+
+            explicit Level(const Vector2i& size);
+        };
+
+        Shader _shader;
+        Mesh _fullscreenTriangle;
+
+        Texture2D _depth;
+        Renderbuffer _color;
+        Framebuffer _framebuffer;
+        std::vector<Level> _levels;
+
+        /* Two readbacks in flight, one written, one read */
+        std::vector<BufferImage2D> _readback;
+        UnsignedInt _frame{};
+        Vector2 _depthRange{0.0f, 1.0f};
+};
+
+}}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Exponents of the positive and negative warp. Squared moments of
+   exp(5.54) still fit into a 16-bit float. */
+#define EVSM_POSITIVE_EXPONENT 5.54
+#define EVSM_NEGATIVE_EXPONENT 5.54
+
+/* Warped depth, the input is window-space depth in 0 -> 1 */
+highp vec2 evsmWarp(highp float depth) {
+    depth = 2.0*depth - 1.0;
+    return vec2(exp(EVSM_POSITIVE_EXPONENT*depth), -exp(-EVSM_NEGATIVE_EXPONENT*depth));
+}
+
+/* First and second moment of the positive and negative warp */
+highp vec4 evsmMoments(highp float depth) {
+    highp vec2 warped = evsmWarp(depth);
+    return vec4(warped.x, warped.x*warped.x, warped.y, warped.y*warped.y);
+}
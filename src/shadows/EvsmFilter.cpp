@@ -0,0 +1,211 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "EvsmFilter.h"
+
+#include <cmath>
+#include <string>
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/Context.h>
+#include <Magnum/DefaultFramebuffer.h>
+#include <Magnum/Shader.h>
+#include <Magnum/TextureFormat.h>
+#include <Magnum/Version.h>
+#include <Magnum/Math/Functions.h>
+
+namespace Magnum { namespace Examples {
+
+EvsmFilter::Shader::Shader() {
+    MAGNUM_ASSERT_VERSION_SUPPORTED(Version::GL330);
+
+    const Utility::Resource rs{"shadow-data"};
+
+    Magnum::Shader vert{Version::GL330, Magnum::Shader::Type::Vertex};
+    Magnum::Shader frag{Version::GL330, Magnum::Shader::Type::Fragment};
+
+    vert.addSource(rs.get("FullscreenTriangle.vert"));
+    frag.addSource("#define MAX_BLUR_RADIUS " + std::to_string(MaxBlurRadius) + "\n");
+    frag.addSource(rs.get("Evsm.glsl"));
+    frag.addSource(rs.get("EvsmFilter.frag"));
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(Magnum::Shader::compile({vert, frag}));
+
+    attachShaders({vert, frag});
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    _inputLayerUniform = uniformLocation("inputLayer");
+    _inputIsDepthUniform = uniformLocation("inputIsDepth");
+    _directionUniform = uniformLocation("direction");
+    _wrapUniform = uniformLocation("wrap");
+    _regionSizeUniform = uniformLocation("regionSize");
+    _weightsUniform = uniformLocation("weights");
+    _radiusUniform = uniformLocation("radius");
+
+    setUniform(uniformLocation("inputTexture"), 0);
+}
+
+EvsmFilter::Shader& EvsmFilter::Shader::setInputTexture(Texture2DArray& texture, const Int layer, const bool isDepth) {
+    texture.bind(0);
+    setUniform(_inputLayerUniform, layer);
+    setUniform(_inputIsDepthUniform, Int(isDepth));
+    return *this;
+}
+
+EvsmFilter::Shader& EvsmFilter::Shader::setDirection(const Vector2i& direction) {
+    setUniform(_directionUniform, direction);
+    return *this;
+}
+
+EvsmFilter::Shader& EvsmFilter::Shader::setWrap(const bool wrap) {
+    setUniform(_wrapUniform, Int(wrap));
+    return *this;
+}
+
+EvsmFilter::Shader& EvsmFilter::Shader::setRegionSize(const Vector2i& size) {
+    setUniform(_regionSizeUniform, size);
+    return *this;
+}
+
+EvsmFilter::Shader& EvsmFilter::Shader::setWeights(const Containers::ArrayView<const Float> weights) {
+    setUniform(_weightsUniform, weights);
+    setUniform(_radiusUniform, Int(weights.size()) - 1);
+    return *this;
+}
+
+EvsmFilter::EvsmFilter(): _temporaryFramebuffer{NoCreate} {
+    /* The vertex shader generates the positions from vertex ID */
+    _fullscreenTriangle.setPrimitive(MeshPrimitive::Triangles)
+        .setCount(3);
+
+    setBlurRadius(2);
+}
+
+void EvsmFilter::setBlurRadius(const Int radius) {
+    CORRADE_INTERNAL_ASSERT(radius >= 0 && radius <= MaxBlurRadius);
+    _blurRadius = radius;
+
+    /* One side of a normalized Gaussian kernel, the radius covers two
+       standard deviations */
+    Float weights[MaxBlurRadius + 1];
+    const Float sigma = Math::max(radius*0.5f, 0.5f);
+    Float sum = 0.0f;
+    for(Int i = 0; i <= radius; ++i) {
+        weights[i] = std::exp(-0.5f*i*i/(sigma*sigma));
+        sum += i ? 2.0f*weights[i] : weights[i];
+    }
+    for(Int i = 0; i <= radius; ++i) weights[i] /= sum;
+
+    _shader.setWeights({weights, std::size_t(radius + 1)});
+    _filterAll = true;
+}
+
+void EvsmFilter::setWrapEnabled(const bool enabled) {
+    if(_wrapEnabled == enabled) return;
+
+    _wrapEnabled = enabled;
+    _shader.setWrap(enabled);
+    _moments.setWrapping(enabled ? Sampler::Wrapping::Repeat : Sampler::Wrapping::ClampToEdge);
+    _filterAll = true;
+}
+
+void EvsmFilter::setup(const Vector2i& size, const Int layerCount) {
+    _size = size;
+    _layerCount = layerCount;
+
+    /* 16-bit floats are enough for the exponents used in Evsm.glsl, full mip
+       chain for the filtered lookups */
+    const Int levels = Math::log2(Math::max(size.x(), size.y())) + 1;
+    (_moments = Texture2DArray{})
+        .setStorage(levels, TextureFormat::RGBA16F, {size, layerCount})
+        .setMinificationFilter(Sampler::Filter::Linear, Sampler::Mipmap::Linear)
+        .setMagnificationFilter(Sampler::Filter::Linear)
+        .setWrapping(_wrapEnabled ? Sampler::Wrapping::Repeat : Sampler::Wrapping::ClampToEdge)
+        .setMaxAnisotropy(Sampler::maxMaxAnisotropy());
+    (_temporary = Texture2DArray{})
+        .setStorage(1, TextureFormat::RGBA16F, {size, 1})
+        .setMinificationFilter(Sampler::Filter::Nearest)
+        .setMagnificationFilter(Sampler::Filter::Nearest);
+
+    _framebuffers.clear();
+    for(Int layer = 0; layer != layerCount; ++layer) {
+        _framebuffers.emplace_back(Range2Di{{}, size});
+        _framebuffers.back().attachTextureLayer(Framebuffer::ColorAttachment{0}, _moments, 0, layer);
+        CORRADE_INTERNAL_ASSERT(_framebuffers.back().checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+    }
+
+    (_temporaryFramebuffer = Framebuffer{{{}, size}})
+        .attachTextureLayer(Framebuffer::ColorAttachment{0}, _temporary, 0, 0);
+    CORRADE_INTERNAL_ASSERT(_temporaryFramebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+
+    _filterAll = true;
+}
+
+void EvsmFilter::filter(Texture2DArray& depth, const Vector2i& size, const Int layerCount, UnsignedInt layers, const Containers::ArrayView<const Vector2> layerScales) {
+    if(size != _size || layerCount != _layerCount)
+        setup(size, layerCount);
+    if(_filterAll) {
+        layers = (1ull << layerCount) - 1;
+        _filterAll = false;
+    }
+    if(!layers) return;
+
+    /* The depth is read directly, not compared */
+    depth.setCompareMode(Sampler::CompareMode::None);
+
+    /* Convert to moments while blurring horizontally into the temporary
+       texture, then blur that vertically into the moments layer */
+    for(Int layer = 0; layer != layerCount; ++layer) {
+        if(!(layers & (1u << layer))) continue;
+
+        /* The whole layer is written, the taps clamp to the rendered part */
+        const Vector2i regionSize = std::size_t(layer) < layerScales.size() ?
+            Math::max(Vector2i{layerScales[layer]*Vector2{size} + Vector2{0.5f}}, Vector2i{1}) : size;
+        _shader.setRegionSize(regionSize);
+
+        _temporaryFramebuffer.bind();
+        _shader.setInputTexture(depth, layer, true)
+            .setDirection(Vector2i::xAxis());
+        _fullscreenTriangle.draw(_shader);
+
+        _framebuffers[layer].bind();
+        _shader.setInputTexture(_temporary, 0, false)
+            .setDirection(Vector2i::yAxis());
+        _fullscreenTriangle.draw(_shader);
+    }
+
+    depth.setCompareMode(Sampler::CompareMode::CompareRefToTexture);
+
+    _moments.generateMipmap();
+
+    defaultFramebuffer.bind();
+}
+
+}}
@@ -0,0 +1,65 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Either the depth shadow map or the horizontally blurred moments */
+uniform highp sampler2DArray inputTexture;
+uniform int inputLayer;
+uniform int inputIsDepth;
+/* Taps wrap around the edges instead of clamping, for clipmap layers */
+uniform int wrap;
+/* Part of the layer that was rendered into, texels outside get the nearest
+   rendered one so the mip chain doesn't mix in stale contents */
+uniform ivec2 regionSize;
+
+uniform ivec2 direction;
+uniform int radius;
+uniform float weights[MAX_BLUR_RADIUS + 1];
+
+out highp vec4 moments;
+
+highp vec4 fetch(ivec2 coords, ivec2 size) {
+    /* The offset keeps the operands of % positive, taps are never further
+       than MAX_BLUR_RADIUS outside */
+    coords = wrap != 0 ? (coords + size*MAX_BLUR_RADIUS) % size : clamp(coords, ivec2(0), regionSize - ivec2(1));
+    highp vec4 value = texelFetch(inputTexture, ivec3(coords, inputLayer), 0);
+    return inputIsDepth != 0 ? evsmMoments(value.r) : value;
+}
+
+void main() {
+    ivec2 size = textureSize(inputTexture, 0).xy;
+    ivec2 coords = ivec2(gl_FragCoord.xy);
+
+    highp vec4 result = weights[0]*fetch(coords, size);
+    for(int i = 1; i <= radius; ++i)
+        result += weights[i]*(fetch(coords + i*direction, size) +
+                              fetch(coords - i*direction, size));
+
+    moments = result;
+}
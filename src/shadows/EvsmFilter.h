@@ -0,0 +1,151 @@
+#ifndef Magnum_Examples_EvsmFilter_h
+#define Magnum_Examples_EvsmFilter_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <vector>
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/Framebuffer.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/TextureArray.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Exponential variance shadow map filter
+
+Converts the depth shadow map layers into exponentially warped moments, blurs
+them with a separable Gaussian filter and generates mipmaps, so the receivers
+can get a soft shadow from a single filtered texture fetch instead of many
+depth comparisons. Only the layers that were rendered again are filtered.
+*/
+class EvsmFilter {
+    public:
+        /** @brief Max blur radius */
+        enum: Int { MaxBlurRadius = 8 };
+
+        explicit EvsmFilter();
+
+        /**
+         * @brief Blur radius in texels
+         *
+         * The kernel has @cpp 2*radius + 1 @ce taps in each direction. Zero
+         * disables the blur, leaving only the mipmap filtering. Default is
+         * @cpp 2 @ce.
+         */
+        Int blurRadius() const { return _blurRadius; }
+
+        /** @brief Set blur radius */
+        void setBlurRadius(Int radius);
+
+        /** @brief Whether the layers wrap around */
+        bool isWrapEnabled() const { return _wrapEnabled; }
+
+        /**
+         * @brief Set whether the layers wrap around
+         *
+         * Enable for layers addressed toroidally, such as with
+         * @ref ShadowLight::setClipmapEnabled(). The blur taps then wrap
+         * around the layer edges and the moments texture uses repeat
+         * wrapping instead of clamping. Filters all layers again on the next
+         * @ref filter() call if changed. Default is @cpp false @ce.
+         */
+        void setWrapEnabled(bool enabled);
+
+        /**
+         * @brief Filter all layers on next @ref filter() call
+         *
+         * Call when the moments got out of sync with the depth, for example
+         * when switching to EVSM after a while.
+         */
+        void invalidate() { _filterAll = true; }
+
+        /**
+         * @brief Filter the shadow map
+         * @param depth         Depth shadow map texture array
+         * @param size          Size of the shadow map
+         * @param layerCount    Layer count of the shadow map
+         * @param layers        Mask of layers to filter
+         * @param layerScales   Part of each layer that was rendered into, see
+         *      @ref ShadowLight::layerTextureScale(). If empty, the whole
+         *      layers are used.
+         *
+         * If @p size or @p layerCount changed since the last call, the
+         * moments texture is recreated and all layers are filtered. Texels
+         * outside of the rendered part of a layer are filled with the
+         * nearest rendered ones, so the blur and the mip chain don't mix in
+         * contents the layer no longer renders.
+         */
+        void filter(Texture2DArray& depth, const Vector2i& size, Int layerCount, UnsignedInt layers, Containers::ArrayView<const Vector2> layerScales = nullptr);
+
+        /** @brief Moments texture */
+        Texture2DArray& moments() { return _moments; }
+
+    private:
+        class Shader: public AbstractShaderProgram {
+            public:
+                explicit Shader();
+
+                Shader& setInputTexture(Texture2DArray& texture, Int layer, bool isDepth);
+                Shader& setDirection(const Vector2i& direction);
+                Shader& setWrap(bool wrap);
+                Shader& setRegionSize(const Vector2i& size);
+                Shader& setWeights(Containers::ArrayView<const Float> weights);
+
+            private:
+                Int _inputLayerUniform,
+                    _inputIsDepthUniform,
+                    _directionUniform,
+                    _wrapUniform,
+                    _regionSizeUniform,
+                    _weightsUniform,
+                    _radiusUniform;
+        };
+
+        void setup(const Vector2i& size, Int layerCount);
+
+        Shader _shader;
+        Mesh _fullscreenTriangle;
+
+        Texture2DArray _moments, _temporary;
+        std::vector<Framebuffer> _framebuffers;
+        Framebuffer _temporaryFramebuffer;
+        Vector2i _size;
+        Int _layerCount{};
+
+        Int _blurRadius{};
+        bool _filterAll{true};
+        bool _wrapEnabled{};
+};
+
+}}
+
+#endif
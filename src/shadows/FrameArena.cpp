@@ -0,0 +1,80 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FrameArena.h"
+
+#include <algorithm>
+
+namespace Magnum { namespace Examples {
+
+FrameArena::FrameArena(const std::size_t capacity) {
+    addBlock(capacity);
+}
+
+std::size_t FrameArena::capacity() const {
+    std::size_t capacity = 0;
+    for(const Containers::Array<char>& block: _blocks)
+        capacity += block.size();
+    return capacity;
+}
+
+void FrameArena::reset() {
+    _peakSize = std::max(_peakSize, _usedSize);
+    _usedSize = 0;
+    _offset = 0;
+
+    /* The frame didn't fit, replace the blocks with one that fits all */
+    if(_blocks.size() > 1) {
+        const std::size_t size = capacity();
+        _blocks.clear();
+        addBlock(size);
+    }
+}
+
+void* FrameArena::allocate(const std::size_t size, const std::size_t alignment) {
+    /* Block memory comes from new[], which is aligned enough for any of the
+       types, so aligning the offset is sufficient */
+    std::size_t offset = (_offset + alignment - 1) & ~(alignment - 1);
+    if(offset + size > _blocks.back().size()) {
+        addBlock(std::max(2*_blocks.back().size(), size + alignment));
+        offset = 0;
+    }
+
+    _offset = offset + size;
+    _usedSize += size;
+    return _blocks.back().data() + offset;
+}
+
+void FrameArena::addBlock(const std::size_t size) {
+    _blocks.emplace_back(Containers::NoInit, size);
+    ++_heapAllocationCount;
+}
+
+}}
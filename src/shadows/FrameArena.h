@@ -0,0 +1,105 @@
+#ifndef Magnum_Examples_FrameArena_h
+#define Magnum_Examples_FrameArena_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <type_traits>
+#include <vector>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/ArrayView.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Bump allocator for per-frame temporaries
+
+Memory is handed out linearly from a block and released all at once with
+@ref reset() at the end of the frame. When a block runs out, a bigger one is
+allocated and the next @ref reset() merges all blocks into one big enough for
+the whole frame, so once the frame size settles there are no heap
+allocations at all. Only trivially destructible types can be allocated, no
+destructors are called.
+*/
+class FrameArena {
+    public:
+        /**
+         * @brief Constructor
+         * @param capacity      Initial capacity in bytes
+         */
+        explicit FrameArena(std::size_t capacity = 64*1024);
+
+        /** @brief Copying is not allowed */
+        FrameArena(const FrameArena&) = delete;
+
+        /** @brief Copying is not allowed */
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        /**
+         * @brief Allocate an array
+         *
+         * The contents are uninitialized. The memory is valid until next
+         * @ref reset().
+         */
+        template<class T> Containers::ArrayView<T> allocate(std::size_t count) {
+            static_assert(std::is_trivially_destructible<T>::value, "the type has to be trivially destructible");
+            return {static_cast<T*>(allocate(count*sizeof(T), alignof(T))), count};
+        }
+
+        /** @brief Release everything allocated since last reset */
+        void reset();
+
+        /** @brief Bytes allocated since last @ref reset() */
+        std::size_t usedSize() const { return _usedSize; }
+
+        /** @brief Largest @ref usedSize() seen so far */
+        std::size_t peakSize() const { return _peakSize; }
+
+        /** @brief Total capacity of all blocks */
+        std::size_t capacity() const;
+
+        /**
+         * @brief Count of heap allocations done by the arena
+         *
+         * Should stop growing after the first few frames.
+         */
+        std::size_t heapAllocationCount() const { return _heapAllocationCount; }
+
+    private:
+        void* allocate(std::size_t size, std::size_t alignment);
+        void addBlock(std::size_t size);
+
+        /* The last block is the one being allocated from */
+        std::vector<Containers::Array<char>> _blocks;
+        std::size_t _offset{}, _usedSize{}, _peakSize{}, _heapAllocationCount{};
+};
+
+}}
+
+#endif
@@ -0,0 +1,64 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MeshPool.h"
+
+#include <Magnum/Mesh.h>
+#include <Magnum/MeshTools/Interleave.h>
+#include <Magnum/Trade/MeshData3D.h>
+
+namespace Magnum { namespace Examples {
+
+MeshPool::Range MeshPool::add(const Trade::MeshData3D& meshData) {
+    CORRADE_INTERNAL_ASSERT(meshData.isIndexed() && meshData.hasNormals());
+
+    const Range range{UnsignedInt(_indexData.size()), UnsignedInt(meshData.indices().size()),
+        Int(_vertexData.size()/VertexStride), UnsignedInt(meshData.positions(0).size())};
+
+    const Containers::Array<char> vertexData = MeshTools::interleave(meshData.positions(0), meshData.normals(0));
+    _vertexData.insert(_vertexData.end(), vertexData.begin(), vertexData.end());
+    _indexData.insert(_indexData.end(), meshData.indices().begin(), meshData.indices().end());
+
+    return range;
+}
+
+void MeshPool::setup(Mesh& mesh, const Range& range) {
+    mesh.setCount(range.indexCount)
+        .setBaseVertex(range.baseVertex)
+        .setIndexBuffer(_indexBuffer, range.indexOffset*sizeof(UnsignedInt), Mesh::IndexType::UnsignedInt,
+            0, range.vertexCount - 1);
+}
+
+void MeshPool::upload() {
+    _vertexBuffer.setData(_vertexData, BufferUsage::StaticDraw);
+    _indexBuffer.setData(_indexData, BufferUsage::StaticDraw);
+}
+
+}}
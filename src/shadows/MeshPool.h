@@ -0,0 +1,96 @@
+#ifndef Magnum_Examples_MeshPool_h
+#define Magnum_Examples_MeshPool_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <vector>
+#include <Magnum/Buffer.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Trade/Trade.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Vertex and index data of many meshes in two shared buffers
+
+Positions and normals of all meshes are interleaved into one vertex buffer
+and 32-bit indices of all meshes appended to one index buffer. Each mesh is
+then referenced by an index range and a base vertex, which allows drawing
+any combination of them with a single multi-draw call.
+*/
+class MeshPool {
+    public:
+        /** @brief Location of a mesh in the shared buffers */
+        struct Range {
+            UnsignedInt indexOffset, indexCount;
+            Int baseVertex;
+            UnsignedInt vertexCount;
+        };
+
+        /** @brief Vertex stride, a position and a normal */
+        enum: UnsignedInt { VertexStride = 6*sizeof(Float) };
+
+        /**
+         * @brief Add a mesh
+         *
+         * The mesh has to be indexed and have normals. All meshes in a pool
+         * are expected to have the same primitive. The data are uploaded
+         * with @ref upload().
+         */
+        Range add(const Trade::MeshData3D& meshData);
+
+        /**
+         * @brief Configure an indexed mesh to draw given range
+         *
+         * Sets the count, index buffer and base vertex, the vertex buffers
+         * have to be added by the caller.
+         */
+        void setup(Mesh& mesh, const Range& range);
+
+        /**
+         * @brief Upload the data
+         *
+         * Uploads all data added so far, replacing the previous contents of
+         * the buffers. Call once after all meshes are added.
+         */
+        void upload();
+
+        Buffer& vertexBuffer() { return _vertexBuffer; }
+        Buffer& indexBuffer() { return _indexBuffer; }
+
+    private:
+        Buffer _vertexBuffer, _indexBuffer;
+        std::vector<char> _vertexData;
+        std::vector<UnsignedInt> _indexData;
+};
+
+}}
+
+#endif
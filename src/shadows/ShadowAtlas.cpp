@@ -0,0 +1,434 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <functional>
+#include <Magnum/DefaultFramebuffer.h>
+#include <Magnum/ImageView.h>
+#include <Magnum/PixelFormat.h>
+#include <Magnum/Renderer.h>
+#include <Magnum/TextureFormat.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/SceneGraph/Camera.h>
+#include <Magnum/SceneGraph/Drawable.h>
+#include <Magnum/SceneGraph/MatrixTransformation3D.h>
+#include <Magnum/SceneGraph/Scene.h>
+
+#include "ShadowCasterBatcher.h"
+#include "ShadowCasterDrawable.h"
+#include "ShadowLight.h"
+#include "TransformCache.h"
+
+namespace Magnum { namespace Examples {
+
+namespace {
+
+/* Look directions and up vectors of the point light cube faces */
+const Vector3 CubeFaceDirections[]{
+    Vector3::xAxis(), -Vector3::xAxis(),
+    Vector3::yAxis(), -Vector3::yAxis(),
+    Vector3::zAxis(), -Vector3::zAxis()
+};
+const Vector3 CubeFaceUps[]{
+    Vector3::yAxis(), Vector3::yAxis(),
+    Vector3::zAxis(), Vector3::zAxis(),
+    Vector3::yAxis(), Vector3::yAxis()
+};
+
+/* Near plane of the light projections relative to their range */
+constexpr Float NearPlaneFactor = 0.01f;
+
+}
+
+ShadowAtlas::ShadowAtlas(const Int size, const Int minTileSize): _size{size}, _maxLevel{Int(Math::log2(UnsignedInt(size/minTileSize)))}, _framebuffer{{{}, Vector2i{size}}} {
+    _texture.setImage(0, TextureFormat::DepthComponent, ImageView2D{PixelFormat::DepthComponent, PixelType::Float, Vector2i{size}, nullptr})
+        .setMaxLevel(0)
+        .setCompareFunction(Sampler::CompareFunction::LessOrEqual)
+        .setCompareMode(Sampler::CompareMode::CompareRefToTexture)
+        .setMinificationFilter(Sampler::Filter::Linear, Sampler::Mipmap::Base)
+        .setMagnificationFilter(Sampler::Filter::Linear);
+
+    _framebuffer.attachTexture(Framebuffer::BufferAttachment::Depth, _texture, 0)
+        .mapForDraw(Framebuffer::DrawAttachment::None)
+        .bind();
+    CORRADE_INTERNAL_ASSERT(_framebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+    defaultFramebuffer.bind();
+
+    /* Initially the whole atlas is one free tile */
+    _freeTiles.resize(_maxLevel + 1);
+    _freeTiles[0].push_back({});
+}
+
+UnsignedInt ShadowAtlas::addSpotLight(const Vector3& position, const Vector3& direction, const Deg angle, const Float range) {
+    CORRADE_INTERNAL_ASSERT(_lights.size() < MaxLights);
+    _lights.emplace_back();
+    _lights.back().point = false;
+    for(Matrix4& matrix: _lights.back().tileMatrices) matrix = Matrix4{Math::ZeroInit};
+    setSpotLight(_lights.size() - 1, position, direction, angle, range);
+    return _lights.size() - 1;
+}
+
+void ShadowAtlas::setSpotLight(const UnsignedInt id, const Vector3& position, const Vector3& direction, const Deg angle, const Float range) {
+    Light& light = _lights[id];
+    light.position = position;
+    light.direction = direction.normalized();
+    light.angle = angle;
+    light.range = range;
+    light.changed = true;
+}
+
+UnsignedInt ShadowAtlas::addPointLight(const Vector3& position, const Float range) {
+    CORRADE_INTERNAL_ASSERT(_lights.size() < MaxLights);
+    _lights.emplace_back();
+    _lights.back().point = true;
+    for(Matrix4& matrix: _lights.back().tileMatrices) matrix = Matrix4{Math::ZeroInit};
+    setPointLight(_lights.size() - 1, position, range);
+    return _lights.size() - 1;
+}
+
+void ShadowAtlas::setPointLight(const UnsignedInt id, const Vector3& position, const Float range) {
+    Light& light = _lights[id];
+    light.position = position;
+    light.range = range;
+    light.changed = true;
+}
+
+Float ShadowAtlas::lightCutoff(const UnsignedInt id) const {
+    return _lights[id].point ? -1.0f : Math::cos(Rad(_lights[id].angle));
+}
+
+void ShadowAtlas::invalidate() {
+    for(Light& light: _lights) light.changed = true;
+}
+
+bool ShadowAtlas::allocate(const Int level, Vector2i& origin) {
+    if(level < 0) return false;
+
+    std::vector<Vector2i>& freeTiles = _freeTiles[level];
+    if(!freeTiles.empty()) {
+        origin = freeTiles.back();
+        freeTiles.pop_back();
+        return true;
+    }
+
+    /* Split a tile from the level above into four */
+    Vector2i parent;
+    if(!allocate(level - 1, parent)) return false;
+    const Int size = _size >> level;
+    freeTiles.push_back(parent + Vector2i{size, 0});
+    freeTiles.push_back(parent + Vector2i{0, size});
+    freeTiles.push_back(parent + Vector2i{size, size});
+    origin = parent;
+    return true;
+}
+
+void ShadowAtlas::release(const Int level, const Vector2i& origin) {
+    std::vector<Vector2i>& freeTiles = _freeTiles[level];
+    if(level == 0) {
+        freeTiles.push_back(origin);
+        return;
+    }
+
+    /* If all three siblings are free, merge them back into the parent */
+    const Int size = _size >> level;
+    const Vector2i parent = origin/(2*size)*(2*size);
+    std::size_t freeSiblings = 0;
+    for(const Vector2i& tile: freeTiles)
+        if(tile/(2*size)*(2*size) == parent) ++freeSiblings;
+    if(freeSiblings != 3) {
+        freeTiles.push_back(origin);
+        return;
+    }
+
+    freeTiles.erase(std::remove_if(freeTiles.begin(), freeTiles.end(), [&](const Vector2i& tile) {
+        return tile/(2*size)*(2*size) == parent;
+    }), freeTiles.end());
+    release(level - 1, parent);
+}
+
+bool ShadowAtlas::allocateLight(Light& light, const Int level) {
+    const UnsignedInt faceCount = light.point ? 6 : 1;
+    for(UnsignedInt face = 0; face != faceCount; ++face) {
+        if(allocate(level, light.tiles[face])) continue;
+
+        /* Not enough space, give back what was allocated so far */
+        for(UnsignedInt i = 0; i != face; ++i) release(level, light.tiles[i]);
+        return false;
+    }
+
+    light.level = level;
+    for(bool& dirty: light.dirty) dirty = true;
+    updateMatrices(light);
+    return true;
+}
+
+void ShadowAtlas::releaseLight(Light& light) {
+    if(light.level == -1) return;
+
+    const UnsignedInt faceCount = light.point ? 6 : 1;
+    for(UnsignedInt face = 0; face != faceCount; ++face)
+        release(light.level, light.tiles[face]);
+    light.level = -1;
+    for(Matrix4& matrix: light.tileMatrices) matrix = Matrix4{Math::ZeroInit};
+}
+
+void ShadowAtlas::updateMatrices(Light& light) {
+    /* Same bias matrix as in ShadowLight, from NDC to texture space */
+    constexpr const Matrix4 bias{{0.5f, 0.0f, 0.0f, 0.0f},
+                                 {0.0f, 0.5f, 0.0f, 0.0f},
+                                 {0.0f, 0.0f, 0.5f, 0.0f},
+                                 {0.5f, 0.5f, 0.5f, 1.0f}};
+
+    const UnsignedInt faceCount = light.point ? 6 : 1;
+    const Float tileScale = Float(_size >> light.level)/_size;
+    for(UnsignedInt face = 0; face != faceCount; ++face) {
+        Vector3 direction, up;
+        Rad fov;
+        if(light.point) {
+            direction = CubeFaceDirections[face];
+            up = CubeFaceUps[face];
+            fov = Rad(Deg(90.0f));
+        } else {
+            direction = light.direction;
+            up = Math::abs(direction.y()) > 0.99f ? Vector3::zAxis() : Vector3::yAxis();
+            fov = Rad(light.angle)*2.0f;
+        }
+
+        const Matrix4 view = Matrix4::lookAt(light.position, light.position + direction, up).invertedRigid();
+        light.viewProjections[face] = Matrix4::perspectiveProjection(fov, 1.0f, light.range*NearPlaneFactor, light.range)*view;
+
+        /* Squeeze the texture space into the tile */
+        const Matrix4 tile = Matrix4::translation({Vector2{light.tiles[face]}/_size, 0.0f})*
+            Matrix4::scaling({tileScale, tileScale, 1.0f});
+        light.tileMatrices[face] = tile*bias*light.viewProjections[face];
+    }
+}
+
+void ShadowAtlas::update(SceneGraph::Camera3D& camera) {
+    const Matrix4 cameraMatrix = camera.cameraMatrix();
+    const Matrix4& projectionMatrix = camera.projectionMatrix();
+    const ShadowLight::ClipPlanes clipPlanes = ShadowLight::calculateClipPlanes(projectionMatrix*cameraMatrix);
+
+    /* Decide the tile level from the size of the light range on the screen,
+       as a fraction of the viewport height. Lights outside of the view don't
+       get any tiles. */
+    std::pair<Float, UnsignedInt> importance[MaxLights];
+    std::size_t importanceCount = 0;
+    Int levels[MaxLights];
+    std::fill_n(levels, MaxLights, -1);
+    for(std::size_t id = 0; id != _lights.size(); ++id) {
+        const Light& light = _lights[id];
+
+        bool visible = true;
+        for(const Vector4& plane: clipPlanes)
+            if(Math::dot(plane.xyz(), light.position) + plane.w() + light.range < 0.0f)
+                visible = false;
+        if(!visible) continue;
+
+        const Float distance = cameraMatrix.transformPoint(light.position).length();
+        const Float fraction = distance <= light.range ? 1.0f :
+            Math::min(light.range*projectionMatrix[1][1]/distance, 1.0f);
+        importance[importanceCount++] = {fraction, UnsignedInt(id)};
+
+        /* The largest tile is a quarter of the atlas */
+        const Float texels = fraction*(_size >> 1);
+        Int level = 1;
+        while(level < _maxLevel && (_size >> level) > texels) ++level;
+        levels[id] = level;
+    }
+
+    /* Keep the tiles if the level is off by at most one, to avoid
+       reallocating and rendering them again on small importance changes */
+    for(std::size_t id = 0; id != _lights.size(); ++id) {
+        Light& light = _lights[id];
+        if(light.level != -1 && levels[id] != -1 && Math::abs(levels[id] - light.level) <= 1)
+            levels[id] = light.level;
+        else releaseLight(light);
+    }
+
+    /* Allocate the most important lights first. If there's not enough
+       space, try smaller tiles. */
+    std::sort(importance, importance + importanceCount, std::greater<std::pair<Float, UnsignedInt>>{});
+    for(std::size_t i = 0; i != importanceCount; ++i) {
+        const UnsignedInt id = importance[i].second;
+        Light& light = _lights[id];
+        if(light.level != -1) continue;
+        for(Int level = levels[id]; level <= _maxLevel && !allocateLight(light, level); ++level);
+    }
+
+    /* Lights that moved need new matrices and all their tiles rendered
+       again */
+    for(Light& light: _lights) {
+        if(!light.changed) continue;
+        light.changed = false;
+        if(light.level == -1) continue;
+        updateMatrices(light);
+        for(bool& dirty: light.dirty) dirty = true;
+    }
+}
+
+void ShadowAtlas::render(SceneGraph::DrawableGroup3D& drawables) {
+    /* Keep the previous state around to detect moved casters */
+    std::swap(_casterObjects, _previousCasterObjects);
+    std::swap(_casterTransformations, _previousCasterTransformations);
+    std::swap(_casterTileMasks, _previousCasterTileMasks);
+
+    _casterObjects.clear();
+    _casterObjects.reserve(drawables.size());
+    for(std::size_t i = 0; i != drawables.size(); ++i)
+        _casterObjects.push_back(static_cast<Object3D&>(drawables[i].object()));
+    if(_transformCache) {
+        _casterTransformations.resize(drawables.size());
+        for(std::size_t i = 0; i != drawables.size(); ++i)
+            _casterTransformations[i] = (*_transformCache)[static_cast<ShadowCasterDrawable&>(drawables[i]).transformIndex()];
+    } else if(drawables.size())
+        _casterTransformations = _casterObjects.front().get().scene()->transformationMatrices(_casterObjects);
+    else _casterTransformations.clear();
+
+    _casterSpheres.reset(drawables.size());
+    for(std::size_t i = 0; i != drawables.size(); ++i)
+        _casterSpheres.set(i, _casterTransformations[i].translation(),
+            static_cast<ShadowCasterDrawable&>(drawables[i]).radius());
+
+    /* Cull the casters for all tiles at once. Tile bits are assigned as six
+       per light so they stay stable when tiles get reallocated. */
+    _casterTileMasks.assign(drawables.size(), 0);
+    for(std::size_t id = 0; id != _lights.size(); ++id) {
+        const Light& light = _lights[id];
+        if(light.level == -1) continue;
+
+        const UnsignedInt faceCount = light.point ? 6 : 1;
+        for(UnsignedInt face = 0; face != faceCount; ++face) {
+            const ShadowLight::ClipPlanes clipPlanes = ShadowLight::calculateClipPlanes(light.viewProjections[face]);
+            _casterSpheres.cull(clipPlanes.data(), clipPlanes.size(), clipPlanes[0], 0.0f,
+                1u << (id*6 + face), _casterTileMasks.data());
+        }
+    }
+
+    /* Tiles touched by casters that moved, appeared or disappeared need to be
+       rendered again */
+    UnsignedInt changedTiles = 0;
+    if(_casterObjects.size() != _previousCasterObjects.size())
+        changedTiles = ~0u;
+    else for(std::size_t i = 0; i != drawables.size(); ++i) {
+        if(&_casterObjects[i].get() != &_previousCasterObjects[i].get()) {
+            changedTiles = ~0u;
+            break;
+        }
+
+        if(_casterTransformations[i] != _previousCasterTransformations[i])
+            changedTiles |= _casterTileMasks[i]|_previousCasterTileMasks[i];
+    }
+
+    /* Collect the tiles to render */
+    UnsignedInt renderedTiles = 0;
+    for(std::size_t id = 0; id != _lights.size(); ++id) {
+        Light& light = _lights[id];
+        if(light.level == -1) continue;
+
+        const UnsignedInt faceCount = light.point ? 6 : 1;
+        for(UnsignedInt face = 0; face != faceCount; ++face) {
+            const UnsignedInt bit = 1u << (id*6 + face);
+            if(light.dirty[face] || (changedTiles & bit)) renderedTiles |= bit;
+            light.dirty[face] = false;
+        }
+    }
+
+    _renderedTileCount = 0;
+    for(UnsignedInt mask = renderedTiles; mask; mask &= mask - 1)
+        ++_renderedTileCount;
+    if(!renderedTiles) return;
+
+    /* Footprint of a caster in texels across, for picking its level of
+       detail */
+    auto casterTexels = [&](const Light& light, const UnsignedInt drawableIndex) {
+        const Float distance = Math::max((_casterTransformations[drawableIndex].translation() - light.position).length(), light.range*NearPlaneFactor);
+        const Float cotangent = light.point ? 1.0f : 1.0f/Math::tan(Rad(light.angle));
+        return 2.0f*static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).radius()*
+            cotangent*(_size >> light.level)*0.5f/distance;
+    };
+
+    /* Group the casters by mesh, a pass per tile */
+    UnsignedInt passes[MaxLights*6];
+    if(_batcher) {
+        _batcher->reset();
+        for(std::size_t id = 0; id != _lights.size(); ++id) {
+            const Light& light = _lights[id];
+            for(UnsignedInt face = 0; face != (light.point ? 6u : 1u); ++face) {
+                const UnsignedInt bit = 1u << (id*6 + face);
+                if(!(renderedTiles & bit)) continue;
+                passes[id*6 + face] = _batcher->addPass();
+                for(std::size_t i = 0; i != drawables.size(); ++i) {
+                    if(!(_casterTileMasks[i] & bit)) continue;
+                    _batcher->add(passes[id*6 + face],
+                        static_cast<ShadowCasterDrawable&>(drawables[i]).mesh(casterTexels(light, i)),
+                        _casterTransformations[i], bit);
+                }
+            }
+        }
+        _batcher->upload();
+    }
+
+    Renderer::setDepthMask(true);
+    Renderer::enable(Renderer::Feature::ScissorTest);
+    _framebuffer.bind();
+
+    for(std::size_t id = 0; id != _lights.size(); ++id) {
+        const Light& light = _lights[id];
+        for(UnsignedInt face = 0; face != (light.point ? 6u : 1u); ++face) {
+            const UnsignedInt bit = 1u << (id*6 + face);
+            if(!(renderedTiles & bit)) continue;
+
+            /* Clear just the tile and render into it */
+            const Range2Di rectangle = Range2Di::fromSize(light.tiles[face], Vector2i{_size >> light.level});
+            _framebuffer.setViewport(rectangle);
+            Renderer::setScissor(rectangle);
+            _framebuffer.clear(FramebufferClear::Depth);
+
+            if(_batcher) {
+                _batcher->draw(passes[id*6 + face], light.viewProjections[face]);
+                continue;
+            }
+
+            for(std::size_t i = 0; i != drawables.size(); ++i) {
+                if(!(_casterTileMasks[i] & bit)) continue;
+                _shader.setTransformationMatrix(light.viewProjections[face]*_casterTransformations[i]);
+                static_cast<ShadowCasterDrawable&>(drawables[i]).mesh(casterTexels(light, i)).draw(_shader);
+            }
+        }
+    }
+
+    Renderer::disable(Renderer::Feature::ScissorTest);
+    defaultFramebuffer.bind();
+}
+
+}}
@@ -0,0 +1,212 @@
+#ifndef Magnum_Examples_ShadowAtlas_h
+#define Magnum_Examples_ShadowAtlas_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <functional>
+#include <vector>
+#include <Magnum/Framebuffer.h>
+#include <Magnum/Texture.h>
+#include <Magnum/Math/Angle.h>
+#include <Magnum/Math/Matrix4.h>
+#include <Magnum/SceneGraph/SceneGraph.h>
+
+#include "ShadowCasterShader.h"
+#include "SphereCuller.h"
+#include "Types.h"
+
+namespace Magnum { namespace Examples {
+
+class ShadowCasterBatcher;
+class TransformCache;
+
+/**
+@brief Shadow atlas for spot and point lights
+
+All lights share a single depth texture. Spot lights get one square tile with
+a perspective projection, point lights get six tiles, one for each cube face.
+Tile sizes are powers of two handed out by a quadtree allocator, the size of a
+light tile depends on how big the light's range appears on the screen. Lights
+outside of the view get no tiles.
+
+A tile is kept as long as the light importance doesn't change too much. A
+tile is rendered again only if it was newly allocated, the light changed or a
+caster overlapping it moved, otherwise its previous contents are reused. The
+casters are culled for all tiles at once, with one bit per tile in a mask,
+same as the cascades in @ref ShadowLight.
+*/
+class ShadowAtlas {
+    public:
+        enum: UnsignedInt {
+            /**
+             * Max light count. Each light can have up to six tiles and each
+             * tile has a bit in the caster mask.
+             */
+            MaxLights = 4
+        };
+
+        /**
+         * @brief Constructor
+         * @param size          Atlas size, power of two
+         * @param minTileSize   Smallest tile size, power of two
+         */
+        explicit ShadowAtlas(Int size, Int minTileSize = 64);
+
+        /** @brief Use a transform cache for caster transformations */
+        void setTransformCache(const TransformCache* cache) { _transformCache = cache; }
+
+        /**
+         * @brief Use instanced rendering
+         *
+         * See @ref ShadowLight::setBatcher() for details.
+         */
+        void setBatcher(ShadowCasterBatcher* batcher) { _batcher = batcher; }
+
+        /**
+         * @brief Add a spot light
+         * @param position      Light position
+         * @param direction     Direction the light is pointing to
+         * @param angle         Half-angle of the light cone
+         * @param range         Light range
+         * @return Light ID
+         */
+        UnsignedInt addSpotLight(const Vector3& position, const Vector3& direction, Deg angle, Float range);
+
+        /** @brief Move a spot light */
+        void setSpotLight(UnsignedInt id, const Vector3& position, const Vector3& direction, Deg angle, Float range);
+
+        /**
+         * @brief Add a point light
+         * @param position      Light position
+         * @param range         Light range
+         * @return Light ID
+         */
+        UnsignedInt addPointLight(const Vector3& position, Float range);
+
+        /** @brief Move a point light */
+        void setPointLight(UnsignedInt id, const Vector3& position, Float range);
+
+        /** @brief Light count */
+        std::size_t lightCount() const { return _lights.size(); }
+
+        bool isPointLight(UnsignedInt id) const { return _lights[id].point; }
+
+        const Vector3& lightPosition(UnsignedInt id) const { return _lights[id].position; }
+
+        /** @brief Light direction, zero for point lights */
+        Vector3 lightDirection(UnsignedInt id) const {
+            return _lights[id].point ? Vector3{} : _lights[id].direction;
+        }
+
+        /** @brief Cosine of the light cone half-angle, -1 for point lights */
+        Float lightCutoff(UnsignedInt id) const;
+
+        Float lightRange(UnsignedInt id) const { return _lights[id].range; }
+
+        /** @brief Size of the light tiles, zero if the light has none */
+        Int tileSize(UnsignedInt id) const {
+            return _lights[id].level == -1 ? 0 : _size >> _lights[id].level;
+        }
+
+        /**
+         * @brief Matrix transforming from world to atlas texture space
+         *
+         * For a spot light only @p face @cpp 0 @ce is valid, point light
+         * faces are ordered +X, -X, +Y, -Y, +Z, -Z. Zero if the light has no
+         * tiles.
+         */
+        const Matrix4& tileMatrix(UnsignedInt id, UnsignedInt face) const {
+            return _lights[id].tileMatrices[face];
+        }
+
+        /**
+         * @brief Allocate the tiles
+         *
+         * Importance of the lights is calculated for given camera.
+         */
+        void update(SceneGraph::Camera3D& camera);
+
+        /** @brief Render the tiles that changed */
+        void render(SceneGraph::DrawableGroup3D& drawables);
+
+        /** @brief Render all tiles on next @ref render() */
+        void invalidate();
+
+        /** @brief Count of tiles rendered in the last @ref render() */
+        UnsignedInt renderedTileCount() const { return _renderedTileCount; }
+
+        Texture2D& texture() { return _texture; }
+
+    private:
+        struct Light {
+            bool point;
+            bool changed{true};
+            Vector3 position, direction;
+            Deg angle;
+            Float range;
+
+            /* Quadtree level of the tiles, -1 if the light has none */
+            Int level{-1};
+            Vector2i tiles[6];
+            Matrix4 viewProjections[6];
+            Matrix4 tileMatrices[6];
+            bool dirty[6];
+        };
+
+        bool allocate(Int level, Vector2i& origin);
+        void release(Int level, const Vector2i& origin);
+        bool allocateLight(Light& light, Int level);
+        void releaseLight(Light& light);
+        void updateMatrices(Light& light);
+
+        Int _size, _maxLevel;
+        Texture2D _texture;
+        Framebuffer _framebuffer;
+        ShadowCasterShader _shader;
+        const TransformCache* _transformCache{};
+        ShadowCasterBatcher* _batcher{};
+
+        std::vector<Light> _lights;
+        /* Origins of free tiles for each quadtree level */
+        std::vector<std::vector<Vector2i>> _freeTiles;
+
+        std::vector<std::reference_wrapper<Object3D>> _casterObjects,
+            _previousCasterObjects;
+        std::vector<Matrix4> _casterTransformations,
+            _previousCasterTransformations;
+        std::vector<UnsignedInt> _casterTileMasks,
+            _previousCasterTileMasks;
+        SphereCuller _casterSpheres;
+        UnsignedInt _renderedTileCount{};
+};
+
+}}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShadowBudget.h"
+
+#include <cmath>
+#include <Magnum/Math/Functions.h>
+
+namespace Magnum { namespace Examples {
+
+namespace {
+
+/* Timer queries in flight, reading a query this many frames later doesn't
+   stall on any sane driver */
+constexpr const std::size_t QueryCount = 4;
+
+/* Weight of a new sample in the smoothed time */
+constexpr const Float Smoothing = 0.1f;
+
+/* Samples over the budget before going down */
+constexpr const UnsignedInt DowngradeSamples = 15;
+
+/* Samples under UpgradeThreshold times the budget before going up. Doubled
+   every time an upgrade turns out to be too early, up to the maximum. */
+constexpr const UnsignedInt UpgradeSamples = 120;
+constexpr const UnsignedInt MaxUpgradeSamples = 3840;
+constexpr const Float UpgradeThreshold = 0.7f;
+
+/* Samples ignored after a change, besides those still in flight, while the
+   driver settles after reallocating the texture */
+constexpr const UnsignedInt SettleSamples = 4;
+
+constexpr const Float LayerScaleFalloffs[]{1.0f, 0.75f, 0.5f};
+constexpr const Float MinLayerScale = 0.25f;
+
+}
+
+Float ShadowBudget::Configuration::layerScale(const Int layer) const {
+    return Math::max(std::pow(layerScaleFalloff, Float(layer)), MinLayerScale);
+}
+
+std::size_t ShadowBudget::Configuration::memory() const {
+    return std::size_t(size)*size*layerCount*(format == TextureFormat::DepthComponent16 ? 2 : 4);
+}
+
+ShadowBudget::ShadowBudget(const Int minSize, const Int maxSize, const Int minLayerCount, const Int maxLayerCount): _minSize{minSize}, _maxSize{maxSize}, _minLayerCount{minLayerCount}, _maxLayerCount{maxLayerCount}, _samplesSinceUpgrade{2*MaxUpgradeSamples}, _upgradeSamples{UpgradeSamples} {
+    CORRADE_INTERNAL_ASSERT(minSize >= 1 && minSize <= maxSize && minLayerCount >= 1 && minLayerCount <= maxLayerCount);
+
+    _queries.reserve(QueryCount);
+    for(std::size_t i = 0; i != QueryCount; ++i)
+        _queries.emplace_back(TimeQuery::Target::TimeElapsed);
+
+    setMemoryBudget(~std::size_t{});
+}
+
+void ShadowBudget::setMemoryBudget(const std::size_t bytes) {
+    _memoryBudget = bytes;
+
+    /* Stay at the same step if it still fits */
+    const bool hadLevels = !_levels.empty();
+    const Configuration previous = hadLevels ? _levels[_level] : Configuration{};
+
+    _levels.clear();
+    auto add = [&](const Int size, const Int layerCount, const Float falloff) {
+        Configuration configuration{size, layerCount, TextureFormat::DepthComponent, falloff};
+        if(configuration.memory() > _memoryBudget)
+            configuration.format = TextureFormat::DepthComponent16;
+        if(configuration.memory() <= _memoryBudget)
+            _levels.push_back(configuration);
+    };
+    for(Int size = _maxSize; size >= _minSize; size /= 2)
+        for(const Float falloff: LayerScaleFalloffs)
+            add(size, _maxLayerCount, falloff);
+    for(Int layerCount = _maxLayerCount - 1; layerCount >= _minLayerCount; --layerCount)
+        add(_minSize, layerCount, LayerScaleFalloffs[2]);
+
+    /* Nothing fits, the smallest one is the best we can do */
+    if(_levels.empty())
+        _levels.push_back({_minSize, _minLayerCount, TextureFormat::DepthComponent16, LayerScaleFalloffs[2]});
+
+    _level = 0;
+    for(std::size_t i = 0; hadLevels && i != _levels.size(); ++i) {
+        if(_levels[i].size == previous.size && _levels[i].layerCount == previous.layerCount &&
+           _levels[i].layerScaleFalloff == previous.layerScaleFalloff) {
+            _level = i;
+            break;
+        }
+    }
+
+    const Configuration& current = _levels[_level];
+    if(!hadLevels || current.size != previous.size || current.layerCount != previous.layerCount ||
+       current.format != previous.format || current.layerScaleFalloff != previous.layerScaleFalloff)
+        setLevel(_level);
+}
+
+void ShadowBudget::begin() {
+    /* All queries still in flight, skip this frame */
+    if(_pendingQueries == _queries.size()) return;
+
+    _queries[_nextQuery].begin();
+    _measuring = true;
+}
+
+void ShadowBudget::end() {
+    if(!_measuring) return;
+
+    _queries[_nextQuery].end();
+    _nextQuery = (_nextQuery + 1)%_queries.size();
+    ++_pendingQueries;
+    _measuring = false;
+}
+
+bool ShadowBudget::update() {
+    /* Read the finished queries, oldest first */
+    while(_pendingQueries) {
+        TimeQuery& query = _queries[(_nextQuery + _queries.size() - _pendingQueries)%_queries.size()];
+        if(!query.resultAvailable()) break;
+        const Float time = query.result<UnsignedLong>()/1.0e6f;
+        --_pendingQueries;
+
+        /* Still measuring the previous configuration */
+        if(_settleSamples) {
+            --_settleSamples;
+            continue;
+        }
+
+        _time = _time != 0.0f ?
+            _time + (time - _time)*Smoothing : time;
+        _samplesSinceUpgrade = Math::min(_samplesSinceUpgrade + 1, 2*MaxUpgradeSamples);
+        if(_timeBudget <= 0.0f) continue;
+
+        if(_time > _timeBudget) {
+            ++_overBudgetSamples;
+            _underBudgetSamples = 0;
+        } else if(_time < _timeBudget*UpgradeThreshold) {
+            ++_underBudgetSamples;
+            _overBudgetSamples = 0;
+        } else _overBudgetSamples = _underBudgetSamples = 0;
+
+        if(_overBudgetSamples >= DowngradeSamples && _level + 1 < _levels.size()) {
+            /* The last upgrade was too optimistic, be more careful next time */
+            if(_samplesSinceUpgrade < 2*_upgradeSamples)
+                _upgradeSamples = Math::min(2*_upgradeSamples, MaxUpgradeSamples);
+            setLevel(_level + 1);
+
+        } else if(_underBudgetSamples >= _upgradeSamples && _level != 0) {
+            setLevel(_level - 1);
+            _samplesSinceUpgrade = 0;
+        }
+    }
+
+    const bool changed = _changed;
+    _changed = false;
+    return changed;
+}
+
+void ShadowBudget::setLevel(const std::size_t level) {
+    _level = level;
+    _changed = true;
+
+    /* Queries still in flight measured the previous configuration */
+    _settleSamples = _pendingQueries + SettleSamples;
+    _overBudgetSamples = _underBudgetSamples = 0;
+    _time = 0.0f;
+}
+
+}}
@@ -0,0 +1,169 @@
+#ifndef Magnum_Examples_ShadowBudget_h
+#define Magnum_Examples_ShadowBudget_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <vector>
+#include <Magnum/TextureFormat.h>
+#include <Magnum/TimeQuery.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Picks shadow map configuration for memory and time budgets
+
+Keeps a ladder of configurations ordered from the best to the worst. Going
+down, the far layers get rendered into a smaller part of their texture layer
+first, then the texture size is halved and once it's at the minimum, layers
+are removed. Each step gets the driver default depth format if it fits into
+the memory budget and 16-bit depth otherwise; steps that don't fit even with
+16-bit depth are left out. The size of the unsized driver default format
+isn't known, it is estimated as four bytes per texel, which is what common
+drivers use for it.
+
+The GPU time of the shadow pass is measured with timer queries that are read
+a few frames later, so the measurement never stalls. If the smoothed time
+stays above the budget for a while, the configuration goes one step down; if
+it stays well below for much longer, one step up. Having to go down again
+shortly after going up makes the next upgrade wait twice as long, so the
+configuration doesn't oscillate around the budget.
+*/
+class ShadowBudget {
+    public:
+        /** @brief Shadow map configuration */
+        struct Configuration {
+            /** Size of the texture layers */
+            Int size;
+            /** Layer count */
+            Int layerCount;
+            /** Depth format */
+            TextureFormat format;
+            /** Resolution scale of each next layer relative to the previous */
+            Float layerScaleFalloff;
+
+            /** @brief Resolution scale of given layer */
+            Float layerScale(Int layer) const;
+
+            /**
+             * @brief Texture memory in bytes
+             *
+             * Estimated with four bytes per texel for the unsized
+             * @ref TextureFormat::DepthComponent.
+             */
+            std::size_t memory() const;
+        };
+
+        /**
+         * @brief Constructor
+         * @param minSize       Minimal texture layer size
+         * @param maxSize       Maximal texture layer size
+         * @param minLayerCount Minimal layer count
+         * @param maxLayerCount Maximal layer count
+         *
+         * The sizes are expected to be powers of two. Starts with the best
+         * configuration and no budgets.
+         */
+        explicit ShadowBudget(Int minSize, Int maxSize, Int minLayerCount, Int maxLayerCount);
+
+        /** @brief Texture memory budget in bytes */
+        std::size_t memoryBudget() const { return _memoryBudget; }
+
+        /**
+         * @brief Set texture memory budget
+         *
+         * If the current configuration doesn't fit, switches to the best one
+         * that does immediately. Default is unlimited.
+         */
+        void setMemoryBudget(std::size_t bytes);
+
+        /** @brief Shadow pass GPU time budget in milliseconds */
+        Float timeBudget() const { return _timeBudget; }
+
+        /**
+         * @brief Set shadow pass GPU time budget
+         *
+         * Zero means unlimited, which is the default.
+         */
+        void setTimeBudget(Float milliseconds) { _timeBudget = milliseconds; }
+
+        /**
+         * @brief Begin measuring the shadow pass
+         *
+         * Call right before rendering the shadow maps. If too many
+         * measurements are still in flight, this frame is skipped.
+         */
+        void begin();
+
+        /** @brief End measuring the shadow pass */
+        void end();
+
+        /**
+         * @brief Collect finished measurements and adapt
+         *
+         * Call once per frame, after @ref end(). Returns @cpp true @ce if
+         * the configuration changed since the last call, either here or in
+         * @ref setMemoryBudget().
+         */
+        bool update();
+
+        /** @brief Current configuration */
+        const Configuration& configuration() const { return _levels[_level]; }
+
+        /** @brief Index of the current configuration, zero is the best */
+        std::size_t level() const { return _level; }
+
+        /** @brief Count of configurations that fit the memory budget */
+        std::size_t levelCount() const { return _levels.size(); }
+
+        /** @brief Smoothed GPU time of the shadow pass in milliseconds */
+        Float time() const { return _time; }
+
+    private:
+        void setLevel(std::size_t level);
+
+        Int _minSize, _maxSize, _minLayerCount, _maxLayerCount;
+        std::size_t _memoryBudget, _level{};
+        Float _timeBudget{};
+        std::vector<Configuration> _levels;
+        bool _changed{};
+
+        /* Ring of timer queries, the oldest pending one is read first */
+        std::vector<TimeQuery> _queries;
+        std::size_t _nextQuery{}, _pendingQueries{};
+        bool _measuring{};
+
+        Float _time{};
+        UnsignedInt _settleSamples{}, _overBudgetSamples{},
+            _underBudgetSamples{}, _samplesSinceUpgrade{}, _upgradeSamples;
+};
+
+}}
+
+#endif
@@ -32,6 +32,27 @@ uniform highp mat4 transformationMatrix;
 
 in highp vec4 position;
 
+/* Used also for the depth pre-pass, where the receivers have to produce
+   exactly the same depth */
+invariant gl_Position;
+
+#ifdef INSTANCED
+in highp mat4 instancedTransformationMatrix;
+
+#ifdef LAYERED
+in highp uint instancedCascadeMask;
+flat out highp uint interpolatedCascadeMask;
+#endif
+#endif
+
 void main() {
+    #ifdef INSTANCED
+    gl_Position = transformationMatrix*instancedTransformationMatrix*position;
+
+    #ifdef LAYERED
+    interpolatedCascadeMask = instancedCascadeMask;
+    #endif
+    #else
     gl_Position = transformationMatrix * position;
+    #endif
 }
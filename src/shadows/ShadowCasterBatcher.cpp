@@ -0,0 +1,168 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShadowCasterBatcher.h"
+
+#include <Magnum/Context.h>
+#include <Magnum/OpenGL.h>
+
+namespace Magnum { namespace Examples {
+
+ShadowCasterBatcher::ShadowCasterBatcher(): _shader{ShadowCasterShader::Flag::Instanced}, _layeredShader{ShadowCasterShader::Flag::Instanced|ShadowCasterShader::Flag::Layered} {
+    /* Cascade mask and transformation are taken from instance data */
+    _layeredShader.setTransformationMatrix(Matrix4{});
+}
+
+void ShadowCasterBatcher::addMesh(Mesh& mesh, Mesh& instancedMesh) {
+    addMesh(mesh, instancedMesh, MeshPool::Range{});
+}
+
+void ShadowCasterBatcher::addMesh(Mesh& mesh, Mesh& instancedMesh, const MeshPool::Range& range) {
+    _meshIds.emplace(&mesh, UnsignedInt(_instancedMeshes.size()));
+    _instancedMeshes.push_back(&instancedMesh);
+    _ranges.push_back(range);
+}
+
+void ShadowCasterBatcher::setMultiDrawMesh(Mesh* const mesh) {
+    #ifndef CORRADE_NO_ASSERT
+    if(mesh) for(const MeshPool::Range& range: _ranges)
+        CORRADE_ASSERT(range.indexCount, "ShadowCasterBatcher::setMultiDrawMesh(): all meshes have to be pooled", );
+    #endif
+    _multiDrawMesh = mesh;
+}
+
+UnsignedInt ShadowCasterBatcher::meshId(Mesh& mesh) const {
+    const auto found = _meshIds.find(&mesh);
+    CORRADE_INTERNAL_ASSERT(found != _meshIds.end());
+    return found->second;
+}
+
+void ShadowCasterBatcher::reset() {
+    _passCount = 0;
+    _drawCount = 0;
+    _entries.clear();
+}
+
+void ShadowCasterBatcher::add(const UnsignedInt pass, Mesh& mesh, const Matrix4& transformationMatrix, const UnsignedInt cascadeMask) {
+    _entries.push_back({UnsignedInt(pass*_instancedMeshes.size() + meshId(mesh)), {transformationMatrix, cascadeMask}});
+}
+
+void ShadowCasterBatcher::upload() {
+    /* Counting sort by batch so each pass/mesh combination is contiguous */
+    _batches.assign(_passCount*_instancedMeshes.size(), {0, 0});
+    for(const Entry& entry: _entries)
+        ++_batches[entry.batch].count;
+
+    UnsignedInt offset = 0;
+    for(Batch& batch: _batches) {
+        batch.offset = offset;
+        offset += batch.count;
+        batch.count = 0;
+    }
+
+    _instances.resize(_entries.size());
+    for(const Entry& entry: _entries) {
+        Batch& batch = _batches[entry.batch];
+        _instances[batch.offset + batch.count++] = entry.instance;
+    }
+
+    _instanceBuffer.setData(_instances, BufferUsage::StreamDraw);
+
+    if(!_multiDrawMesh) return;
+
+    /* One command for each non-empty batch, the base instance points to its
+       instance data */
+    _commands.clear();
+    _passCommands.resize(_passCount);
+    for(UnsignedInt pass = 0; pass != _passCount; ++pass) {
+        _passCommands[pass].offset = _commands.size();
+        for(std::size_t meshId = 0; meshId != _instancedMeshes.size(); ++meshId) {
+            const Batch& batch = _batches[pass*_instancedMeshes.size() + meshId];
+            if(!batch.count) continue;
+
+            const MeshPool::Range& range = _ranges[meshId];
+            _commands.push_back({range.indexCount, batch.count, range.indexOffset, range.baseVertex, batch.offset});
+        }
+        _passCommands[pass].count = _commands.size() - _passCommands[pass].offset;
+    }
+
+    _commandBuffer.setData(_commands, BufferUsage::StreamDraw);
+}
+
+void ShadowCasterBatcher::draw(const UnsignedInt pass, const Matrix4& transformationMatrix) {
+    _shader.setTransformationMatrix(transformationMatrix);
+    drawBatches(pass, _shader);
+}
+
+void ShadowCasterBatcher::drawLayered(const UnsignedInt pass, const Containers::ArrayView<const Matrix4> layerMatrices) {
+    _layeredShader.setLayerMatrices(layerMatrices);
+    drawBatches(pass, _layeredShader);
+}
+
+void ShadowCasterBatcher::drawIndirect(Buffer& commandBuffer, const std::size_t offset, const UnsignedInt count, const Matrix4& transformationMatrix) {
+    CORRADE_INTERNAL_ASSERT(_multiDrawMesh);
+    _shader.setTransformationMatrix(transformationMatrix);
+    multiDraw(_shader, commandBuffer, offset, count);
+}
+
+void ShadowCasterBatcher::drawBatches(const UnsignedInt pass, ShadowCasterShader& shader) {
+    if(_multiDrawMesh) {
+        const Batch& commands = _passCommands[pass];
+        multiDraw(shader, _commandBuffer, commands.offset, commands.count);
+        return;
+    }
+
+    for(std::size_t meshId = 0; meshId != _instancedMeshes.size(); ++meshId) {
+        const Batch& batch = _batches[pass*_instancedMeshes.size() + meshId];
+        if(!batch.count) continue;
+
+        _instancedMeshes[meshId]->setInstanceCount(batch.count)
+            .setBaseInstance(batch.offset)
+            .draw(shader);
+        ++_drawCount;
+    }
+}
+
+void ShadowCasterBatcher::multiDraw(ShadowCasterShader& shader, Buffer& commandBuffer, const std::size_t offset, const UnsignedInt count) {
+    if(!count) return;
+
+    /* Magnum has no multi-draw, so bind the program, the pooled mesh and the
+       command buffer directly and let Magnum know its state is stale */
+    glUseProgram(shader.id());
+    glBindVertexArray(_multiDrawMesh->id());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.id());
+    glMultiDrawElementsIndirect(GLenum(_multiDrawMesh->primitive()), GL_UNSIGNED_INT,
+        reinterpret_cast<const GLvoid*>(offset*sizeof(DrawCommand)), count, 0);
+    Context::current().resetState(Context::State::Buffers|Context::State::Meshes|Context::State::Shaders);
+
+    ++_drawCount;
+}
+
+}}
@@ -0,0 +1,201 @@
+#ifndef Magnum_Examples_ShadowCasterBatcher_h
+#define Magnum_Examples_ShadowCasterBatcher_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <unordered_map>
+#include <vector>
+#include <Magnum/Buffer.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Math/Matrix4.h>
+
+#include "MeshPool.h"
+#include "ShadowCasterShader.h"
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Groups shadow casters by mesh for instanced drawing
+
+Casters are collected into passes (one per layer, or a single one for
+layered rendering), grouped by mesh and their world transformations and
+cascade masks uploaded into a single per-frame instance buffer. Each pass
+then issues just one instanced draw per mesh. Requires
+@extension{ARB,base_instance}.
+
+If all meshes live in a @ref MeshPool, the per-mesh draws of a pass can be
+replaced with a single @fn_gl{MultiDrawElementsIndirect} call, see
+@ref setMultiDrawMesh().
+*/
+class ShadowCasterBatcher {
+    public:
+        /** @brief Instance data */
+        struct Instance {
+            Matrix4 transformationMatrix;
+            UnsignedInt cascadeMask;
+        };
+
+        /** @brief Indirect draw command, layout given by @fn_gl{MultiDrawElementsIndirect} */
+        struct DrawCommand {
+            UnsignedInt count, instanceCount, firstIndex;
+            Int baseVertex;
+            UnsignedInt baseInstance;
+        };
+
+        explicit ShadowCasterBatcher();
+
+        /**
+         * @brief Instance buffer
+         *
+         * Add it to the instanced meshes with
+         * @ref ShadowCasterShader::TransformationMatrix and
+         * @ref ShadowCasterShader::CascadeMask attributes, a divisor of 1 and
+         * zero offset.
+         */
+        Buffer& instanceBuffer() { return _instanceBuffer; }
+
+        /**
+         * @brief Register an instanced variant of a mesh
+         *
+         * The @p instancedMesh should share vertex and index data with
+         * @p mesh and have @ref instanceBuffer() attached.
+         */
+        void addMesh(Mesh& mesh, Mesh& instancedMesh);
+
+        /**
+         * @brief Register an instanced variant of a pooled mesh
+         *
+         * Same as above, additionally remembering where the mesh is in the
+         * pool for multi-draw.
+         */
+        void addMesh(Mesh& mesh, Mesh& instancedMesh, const MeshPool::Range& range);
+
+        /**
+         * @brief Draw each pass with a single indirect multi-draw
+         *
+         * The @p mesh should reference the whole @ref MeshPool all meshes
+         * were added from, with @ref instanceBuffer() attached same as for
+         * the instanced meshes. Pass @cpp nullptr @ce to draw mesh by mesh
+         * again. Requires @extension{ARB,multi_draw_indirect}.
+         */
+        void setMultiDrawMesh(Mesh* mesh);
+
+        /** @brief Mesh used for multi-draw */
+        Mesh* multiDrawMesh() const { return _multiDrawMesh; }
+
+        /** @brief Count of registered meshes */
+        std::size_t meshCount() const { return _instancedMeshes.size(); }
+
+        /**
+         * @brief ID of a registered mesh
+         *
+         * In order the meshes were added with @ref addMesh().
+         */
+        UnsignedInt meshId(Mesh& mesh) const;
+
+        /** @brief Pool range of given mesh */
+        const MeshPool::Range& meshRange(UnsignedInt id) const { return _ranges[id]; }
+
+        /** @brief Remove all passes and instances */
+        void reset();
+
+        /** @brief Add a pass, returns its ID */
+        UnsignedInt addPass() { return _passCount++; }
+
+        /** @brief Add a mesh instance to given pass */
+        void add(UnsignedInt pass, Mesh& mesh, const Matrix4& transformationMatrix, UnsignedInt cascadeMask);
+
+        /** @brief Group the instances by mesh and upload them */
+        void upload();
+
+        /**
+         * @brief Draw a pass
+         * @param pass              Pass ID
+         * @param transformationMatrix Camera and projection matrix
+         */
+        void draw(UnsignedInt pass, const Matrix4& transformationMatrix);
+
+        /**
+         * @brief Draw a pass to a layered framebuffer
+         * @param pass              Pass ID
+         * @param layerMatrices     Camera and projection matrix of each layer
+         */
+        void drawLayered(UnsignedInt pass, Containers::ArrayView<const Matrix4> layerMatrices);
+
+        /**
+         * @brief Draw with externally generated commands
+         * @param commandBuffer     Buffer with @ref DrawCommand entries
+         * @param offset            Offset of the first command, in commands
+         * @param count             Command count
+         * @param transformationMatrix Camera and projection matrix
+         *
+         * The commands reference @ref instanceBuffer() and the pool attached
+         * to @ref multiDrawMesh(), which is expected to be set. Issues a
+         * single @fn_gl{MultiDrawElementsIndirect} call.
+         */
+        void drawIndirect(Buffer& commandBuffer, std::size_t offset, UnsignedInt count, const Matrix4& transformationMatrix);
+
+        /** @brief Count of draw calls issued since last @ref reset() */
+        UnsignedInt drawCount() const { return _drawCount; }
+
+    private:
+        struct Entry {
+            UnsignedInt batch;
+            Instance instance;
+        };
+
+        struct Batch {
+            UnsignedInt offset, count;
+        };
+
+        void drawBatches(UnsignedInt pass, ShadowCasterShader& shader);
+        void multiDraw(ShadowCasterShader& shader, Buffer& commandBuffer, std::size_t offset, UnsignedInt count);
+
+        ShadowCasterShader _shader, _layeredShader;
+        Buffer _instanceBuffer, _commandBuffer;
+        Mesh* _multiDrawMesh{};
+
+        std::vector<Mesh*> _instancedMeshes;
+        /* Index count of ranges not in a pool is zero */
+        std::vector<MeshPool::Range> _ranges;
+        std::unordered_map<Mesh*, UnsignedInt> _meshIds;
+
+        UnsignedInt _passCount{}, _drawCount{};
+        std::vector<Entry> _entries;
+        std::vector<Instance> _instances;
+        std::vector<Batch> _batches;
+        /* Commands of each pass are contiguous, indexed by pass */
+        std::vector<DrawCommand> _commands;
+        std::vector<Batch> _passCommands;
+};
+
+}}
+
+#endif
@@ -43,4 +43,15 @@ void ShadowCasterDrawable::draw(const Matrix4& transformationMatrix, SceneGraph:
     _mesh->draw(*_shader);
 }
 
+void ShadowCasterDrawable::draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& shadowCamera, const Float texels) {
+    _shader->setTransformationMatrix(shadowCamera.projectionMatrix()*transformationMatrix);
+    mesh(texels).draw(*_shader);
+}
+
+void ShadowCasterDrawable::drawLayered(ShadowCasterShader& shader, const Matrix4& transformationMatrix, const UnsignedInt cascadeMask, const Float texels) {
+    shader.setTransformationMatrix(transformationMatrix)
+        .setCascadeMask(cascadeMask);
+    mesh(texels).draw(shader);
+}
+
 }}
@@ -30,6 +30,7 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <Corrade/Containers/ArrayView.h>
 #include <Magnum/Mesh.h>
 #include <Magnum/SceneGraph/Drawable.h>
 #include <Magnum/SceneGraph/Object.h>
@@ -38,6 +39,13 @@ namespace Magnum { namespace Examples {
 
 class ShadowCasterShader;
 
+/** @brief Level of detail of a shadow caster mesh */
+struct ShadowCasterLod {
+    Mesh* mesh;
+    /** Used when the caster is at most this many texels across */
+    Float maxTexels;
+};
+
 class ShadowCasterDrawable: public SceneGraph::Drawable3D {
     public:
         explicit ShadowCasterDrawable(SceneGraph::AbstractObject3D& parent, SceneGraph::DrawableGroup3D* drawables);
@@ -52,14 +60,66 @@ class ShadowCasterDrawable: public SceneGraph::Drawable3D {
             _shader = &shader;
         }
 
+        Mesh& mesh() { return *_mesh; }
+
+        /**
+         * @brief Set lower levels of detail
+         *
+         * Ordered from the finest to the coarsest, i.e. with decreasing
+         * @ref ShadowCasterLod::maxTexels. The view is expected to stay valid
+         * for the whole drawable lifetime.
+         */
+        void setLods(Containers::ArrayView<const ShadowCasterLod> lods) { _lods = lods; }
+
+        /** @brief Lower levels of detail */
+        Containers::ArrayView<const ShadowCasterLod> lods() const { return _lods; }
+
+        /**
+         * @brief Mesh for given footprint
+         *
+         * Returns the coarsest level of detail that can be used for a caster
+         * that is @p texels across in the shadow map, or the mesh set in
+         * @ref setMesh() if there's none.
+         */
+        Mesh& mesh(Float texels) {
+            for(std::size_t i = _lods.size(); i != 0; --i)
+                if(texels <= _lods[i - 1].maxTexels) return *_lods[i - 1].mesh;
+            return *_mesh;
+        }
+
+        /** @brief Set index of the object in a @ref TransformCache */
+        void setTransformIndex(UnsignedInt index) { _transformIndex = index; }
+
+        UnsignedInt transformIndex() const { return _transformIndex; }
+
         Float radius() const { return _radius; }
 
         void draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& shadowCamera) override;
 
+        /**
+         * @brief Draw with a level of detail for given footprint
+         *
+         * See @ref mesh(Float) for details.
+         */
+        void draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& shadowCamera, Float texels);
+
+        /**
+         * @brief Draw to all layers set in the cascade mask at once
+         *
+         * The @p shader is expected to have @ref ShadowCasterShader::Flag::Layered
+         * set and the per-layer matrices already uploaded. Unlike in
+         * @ref draw(), the @p transformationMatrix is the world transformation.
+         * The level of detail is picked for @p texels, which should be the
+         * footprint in the finest layer of the mask.
+         */
+        void drawLayered(ShadowCasterShader& shader, const Matrix4& transformationMatrix, UnsignedInt cascadeMask, Float texels);
+
     private:
         Mesh* _mesh{};
+        Containers::ArrayView<const ShadowCasterLod> _lods;
         ShadowCasterShader* _shader{};
         Float _radius;
+        UnsignedInt _transformIndex{};
 };
 
 }}
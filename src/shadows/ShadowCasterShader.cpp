@@ -38,7 +38,7 @@
 
 namespace Magnum { namespace Examples {
 
-ShadowCasterShader::ShadowCasterShader() {
+ShadowCasterShader::ShadowCasterShader(const Flags flags): _flags{flags} {
     MAGNUM_ASSERT_VERSION_SUPPORTED(Version::GL330);
 
     const Utility::Resource rs{"shadow-data"};
@@ -46,16 +46,44 @@ ShadowCasterShader::ShadowCasterShader() {
     Shader vert{Version::GL330, Shader::Type::Vertex};
     Shader frag{Version::GL330, Shader::Type::Fragment};
 
-    vert.addSource(rs.get("ShadowCaster.vert"));
+    const std::string defines =
+        std::string{flags & Flag::Layered ? "#define LAYERED\n" : ""} +
+        std::string{flags & Flag::Instanced ? "#define INSTANCED\n" : ""};
+
+    vert.addSource(defines)
+        .addSource(rs.get("ShadowCaster.vert"));
     frag.addSource(rs.get("ShadowCaster.frag"));
 
-    CORRADE_INTERNAL_ASSERT_OUTPUT(Shader::compile({vert, frag}));
+    if(flags & Flag::Layered) {
+        Shader geom{Version::GL330, Shader::Type::Geometry};
+        geom.addSource(defines)
+            .addSource("#define MAX_LAYERS " + std::to_string(MaxLayers) + "\n")
+            .addSource(rs.get("ShadowCaster.geom"));
+
+        CORRADE_INTERNAL_ASSERT_OUTPUT(Shader::compile({vert, geom, frag}));
+
+        attachShaders({vert, geom, frag});
+    } else {
+        CORRADE_INTERNAL_ASSERT_OUTPUT(Shader::compile({vert, frag}));
 
-    attachShaders({vert, frag});
+        attachShaders({vert, frag});
+    }
+
+    bindAttributeLocation(Position::Location, "position");
+    if(flags & Flag::Instanced) {
+        bindAttributeLocation(TransformationMatrix::Location, "instancedTransformationMatrix");
+        if(flags & Flag::Layered)
+            bindAttributeLocation(CascadeMask::Location, "instancedCascadeMask");
+    }
 
     CORRADE_INTERNAL_ASSERT_OUTPUT(link());
 
     _transformationMatrixUniform = uniformLocation("transformationMatrix");
+    if(flags & Flag::Layered) {
+        _layerMatricesUniform = uniformLocation("layerMatrices");
+        if(!(flags & Flag::Instanced))
+            _cascadeMaskUniform = uniformLocation("cascadeMask");
+    }
 }
 
 ShadowCasterShader& ShadowCasterShader::setTransformationMatrix(const Matrix4& matrix) {
@@ -63,4 +91,16 @@ ShadowCasterShader& ShadowCasterShader::setTransformationMatrix(const Matrix4& m
     return *this;
 }
 
+ShadowCasterShader& ShadowCasterShader::setLayerMatrices(const Containers::ArrayView<const Matrix4> matrices) {
+    CORRADE_INTERNAL_ASSERT(_flags & Flag::Layered && matrices.size() <= MaxLayers);
+    setUniform(_layerMatricesUniform, matrices);
+    return *this;
+}
+
+ShadowCasterShader& ShadowCasterShader::setCascadeMask(const UnsignedInt mask) {
+    CORRADE_INTERNAL_ASSERT(_flags & Flag::Layered && !(_flags & Flag::Instanced));
+    setUniform(_cascadeMaskUniform, mask);
+    return *this;
+}
+
 }}
@@ -30,27 +30,93 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <Corrade/Containers/EnumSet.h>
 #include <Magnum/AbstractShaderProgram.h>
+#include <Magnum/Shaders/Generic.h>
 
 namespace Magnum { namespace Examples {
 
 class ShadowCasterShader: public AbstractShaderProgram {
     public:
-        explicit ShadowCasterShader();
+        typedef Shaders::Generic3D::Position Position;
+
+        /**
+         * @brief Per-instance world transformation
+         *
+         * Used only in @ref Flag::Instanced mode.
+         */
+        typedef Attribute<4, Matrix4> TransformationMatrix;
+
+        /**
+         * @brief Per-instance cascade mask
+         *
+         * Used only in @ref Flag::Instanced together with @ref Flag::Layered
+         * mode, replaces @ref setCascadeMask().
+         */
+        typedef Attribute<8, UnsignedInt> CascadeMask;
+
+        /** @brief Maximal layer count in @ref Flag::Layered mode */
+        enum: UnsignedInt { MaxLayers = 32 };
+
+        enum class Flag: UnsignedByte {
+            /**
+             * Render to a layered framebuffer. A geometry shader emits each
+             * triangle to all layers set in @ref setCascadeMask().
+             */
+            Layered = 1 << 0,
+
+            /**
+             * Take world transformation (and cascade mask in
+             * @ref Flag::Layered mode) from per-instance attributes.
+             */
+            Instanced = 1 << 1
+        };
+
+        typedef Containers::EnumSet<Flag> Flags;
+
+        explicit ShadowCasterShader(Flags flags = {});
+
+        Flags flags() const { return _flags; }
 
         /**
          * @brief Set transformation matrix
          *
          * Matrix that transforms from local model space -> world space ->
          * camera space -> clip coordinates (aka model-view-projection
-         * matrix).
+         * matrix). In @ref Flag::Layered mode this is only the model matrix,
+         * the rest is done by @ref setLayerMatrices(). In @ref Flag::Instanced
+         * mode this is applied after the per-instance
+         * @ref TransformationMatrix, i.e. it's only the camera and projection
+         * part.
          */
         ShadowCasterShader& setTransformationMatrix(const Matrix4& matrix);
 
+        /**
+         * @brief Set per-layer matrices
+         *
+         * Matrices that transform from world space -> camera space -> clip
+         * coordinates for each layer. Available only in @ref Flag::Layered
+         * mode.
+         */
+        ShadowCasterShader& setLayerMatrices(Containers::ArrayView<const Matrix4> matrices);
+
+        /**
+         * @brief Set cascade mask
+         *
+         * Bit @p i set means the mesh is rendered into layer @p i. Available
+         * only in @ref Flag::Layered mode without @ref Flag::Instanced.
+         */
+        ShadowCasterShader& setCascadeMask(UnsignedInt mask);
+
     private:
-        Int _transformationMatrixUniform;
+        Flags _flags;
+        Int _transformationMatrixUniform,
+            _layerMatricesUniform{-1},
+            _cascadeMaskUniform{-1};
 };
 
+CORRADE_ENUMSET_OPERATORS(ShadowCasterShader::Flags)
+
 }}
 
 #endif
@@ -36,23 +36,65 @@
 #include <Magnum/PixelFormat.h>
 #include <Magnum/Renderer.h>
 #include <Magnum/TextureFormat.h>
+#include <Magnum/Math/Constants.h>
 #include <Magnum/SceneGraph/FeatureGroup.h>
 #include <Magnum/SceneGraph/MatrixTransformation3D.h>
 #include <Magnum/SceneGraph/Scene.h>
 
+#include "CasterCuller.h"
+#include "ShadowCasterBatcher.h"
 #include "ShadowCasterDrawable.h"
+#include "ShadowCasterShader.h"
+#include "TransformCache.h"
+#include "WorkerPool.h"
 
 namespace Magnum { namespace Examples {
 
-ShadowLight::ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent): SceneGraph::Camera3D{parent}, _object(parent), _shadowTexture{NoCreate} {
+namespace {
+
+/* Conversion between linear distance from the camera and window-space depth
+   for a perspective projection */
+Float linearDepth(const Float zNear, const Float zFar, const Float depth) {
+    const Float depthSample = 2.0f*depth - 1.0f;
+    return 2.0f*zNear*zFar/(zFar + zNear - depthSample*(zFar - zNear));
+}
+
+Float windowDepth(const Float zNear, const Float zFar, const Float linearDepth) {
+    const Float nonLinearDepth = (zFar + zNear - 2.0f*zNear*zFar/linearDepth)/(zFar - zNear);
+    return (nonLinearDepth + 1.0f)/2.0f;
+}
+
+/* Division rounding towards negative infinity */
+Int floorDivide(const Int a, const Int b) {
+    return a >= 0 ? a/b : -((b - a - 1)/b);
+}
+
+Vector2i floorDivide(const Vector2i& a, const Int b) {
+    return {floorDivide(a.x(), b), floorDivide(a.y(), b)};
+}
+
+/* Projecting world points normalized device coordinates means they range
+   -1 -> 1. Use this bias matrix so we go straight from world -> texture
+   space */
+constexpr const Matrix4 ShadowBias{{0.5f, 0.0f, 0.0f, 0.0f},
+                                   {0.0f, 0.5f, 0.0f, 0.0f},
+                                   {0.0f, 0.0f, 0.5f, 0.0f},
+                                   {0.5f, 0.5f, 0.5f, 1.0f}};
+
+}
+
+ShadowLight::ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent): SceneGraph::Camera3D{parent}, _object(parent), _shadowTexture{NoCreate}, _layeredFramebuffer{NoCreate} {
     setAspectRatioPolicy(SceneGraph::AspectRatioPolicy::NotPreserved);
 }
 
 void ShadowLight::setupShadowmaps(Int numShadowLevels, const Vector2i& size) {
     _layers.clear();
+    _shadowMapSize = size;
 
     (_shadowTexture = Texture2DArray{})
-        .setImage(0, TextureFormat::DepthComponent, ImageView3D{PixelFormat::DepthComponent, PixelType::Float, {size, numShadowLevels}, nullptr})
+        .setImage(0, _shadowmapFormat, ImageView3D{PixelFormat::DepthComponent,
+            _shadowmapFormat == TextureFormat::DepthComponent16 ? PixelType::UnsignedShort : PixelType::Float,
+            {size, numShadowLevels}, nullptr})
         .setMaxLevel(0)
         .setCompareFunction(Sampler::CompareFunction::LessOrEqual)
         .setCompareMode(Sampler::CompareMode::CompareRefToTexture)
@@ -67,37 +109,143 @@ void ShadowLight::setupShadowmaps(Int numShadowLevels, const Vector2i& size) {
             .bind();
         CORRADE_INTERNAL_ASSERT(shadowFramebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
     }
+
+    /* Framebuffer with all layers attached for rendering them at once */
+    (_layeredFramebuffer = Framebuffer{{{}, size}})
+        .attachLayeredTexture(Framebuffer::BufferAttachment::Depth, _shadowTexture, 0)
+        .mapForDraw(Framebuffer::DrawAttachment::None)
+        .bind();
+    CORRADE_INTERNAL_ASSERT(_layeredFramebuffer.checkStatus(FramebufferTarget::Draw) == Framebuffer::Status::Complete);
+
+    defaultFramebuffer.bind();
+}
+
+void ShadowLight::setMaxUpdateInterval(const UnsignedInt frames) {
+    CORRADE_INTERNAL_ASSERT(frames);
+    _maxUpdateIntervalLog2 = Math::log2(frames);
+}
+
+void ShadowLight::invalidate() {
+    for(ShadowLayerData& d: _layers) d.dirty = true;
+}
+
+void ShadowLight::setClipmapEnabled(const bool enabled) {
+    CORRADE_ASSERT(!enabled || _shadowMapSize.x() == _shadowMapSize.y(),
+        "ShadowLight::setClipmapEnabled(): expected square shadow maps", );
+    _clipmapEnabled = enabled;
+    invalidate();
+}
+
+void ShadowLight::setLayerScale(const Int layer, const Float scale) {
+    CORRADE_ASSERT(scale > 0.0f && scale <= 1.0f,
+        "ShadowLight::setLayerScale(): expected scale in (0, 1] but got" << scale, );
+    if(_layers[layer].scale == scale) return;
+    _layers[layer].scale = scale;
+    _layers[layer].dirty = true;
+}
+
+Vector2i ShadowLight::layerSize(const std::size_t layer) const {
+    if(_layeredShader || _clipmapEnabled) return _shadowMapSize;
+    return Math::max(Vector2i{Vector2{_shadowMapSize}*_layers[layer].scale}, Vector2i{1});
+}
+
+Vector2 ShadowLight::layerWrapOffset(const Int layer) const {
+    if(!_clipmapEnabled) return {};
+
+    /* Texel at the window origin is at this position in the texture */
+    const Int size = _shadowMapSize.x();
+    const Vector2i origin = _layers[layer].clipmapOrigin;
+    return Vector2{origin - floorDivide(origin, size)*size}/Float(size);
 }
 
 ShadowLight::ShadowLayerData::ShadowLayerData(const Vector2i& size): shadowFramebuffer{{{}, size}} {}
 
 void ShadowLight::setTarget(const Vector3& lightDirection, const Vector3& screenDirection, SceneGraph::Camera3D& mainCamera) {
-    Matrix4 cameraMatrix = Matrix4::lookAt({}, -lightDirection, screenDirection);
+    /* Clipmap layers need an orientation that doesn't change with the
+       camera */
+    Vector3 upDirection = screenDirection;
+    if(_clipmapEnabled)
+        upDirection = Math::abs(Math::dot(lightDirection.normalized(), Vector3::yAxis())) > 0.99f ?
+            Vector3::zAxis() : Vector3::yAxis();
+
+    Matrix4 cameraMatrix = Matrix4::lookAt({}, -lightDirection, upDirection);
     const Matrix3x3 cameraRotationMatrix = cameraMatrix.rotation();
     const Matrix3x3 inverseCameraRotationMatrix = cameraRotationMatrix.inverted();
+    _clipmapRotation = cameraRotationMatrix;
 
     for(std::size_t layerIndex = 0; layerIndex != _layers.size(); ++layerIndex) {
-        std::vector<Vector3> mainCameraFrustumCorners = layerFrustumCorners(mainCamera, Int(layerIndex));
+        const FrustumCorners mainCameraFrustumCorners = layerFrustumCorners(mainCamera, Int(layerIndex));
         ShadowLayerData& layer = _layers[layerIndex];
 
-        /* Calculate the AABB in shadow-camera space */
-        Vector3 min{std::numeric_limits<Float>::max()}, max{std::numeric_limits<Float>::lowest()};
-        for(Vector3 worldPoint: mainCameraFrustumCorners) {
-            Vector3 cameraPoint = inverseCameraRotationMatrix*worldPoint;
-            min = Math::min(min, cameraPoint);
-            max = Math::max(max, cameraPoint);
-        }
+        Vector3 cameraPosition;
+        if(_stableFitting || _clipmapEnabled) {
+            /* Bound the slice with a sphere around its centroid. The distances
+               don't depend on camera rotation, round the radius up so
+               floating-point error doesn't change it between frames either. */
+            Vector3 centre;
+            for(Vector3 worldPoint: mainCameraFrustumCorners)
+                centre += worldPoint;
+            centre /= Float(mainCameraFrustumCorners.size());
+
+            Float radius = 0.0f;
+            for(Vector3 worldPoint: mainCameraFrustumCorners)
+                radius = Math::max(radius, (worldPoint - centre).length());
+            radius = std::ceil(radius*16.0f)/16.0f;
+
+            /* Snap the centre to texel increments in shadow-camera space so
+               the shadow map contents move by whole texels only. The map is
+               one texel larger than the sphere, half a texel on each side,
+               which covers rounding the centre to the nearest texel. */
+            const Vector2i size = layerSize(layerIndex);
+            const Vector2 texelSize = Vector2{2.0f*radius}/Vector2{size - Vector2i{1}};
+
+            /* The window of a clipmap layer is aligned to a grid of texels
+               going through the world origin, the shadow camera sits in its
+               middle, on the plane going through the origin */
+            if(_clipmapEnabled) {
+                layer.clipmapTexelSize = texelSize.x();
+                layer.clipmapOrigin = Vector2i{Math::floor((inverseCameraRotationMatrix*centre).xy()/texelSize.x() + Vector2{0.5f})} - size/2;
+                cameraPosition = cameraRotationMatrix*Vector3{(Vector2{layer.clipmapOrigin} + Vector2{size}*0.5f)*texelSize.x(), 0.0f};
+                layer.orthographicSize = Vector2{size}*texelSize.x();
+                layer.orthographicNear = -_clipmapDepthRange;
+                layer.orthographicFar = _clipmapDepthRange;
+                cameraMatrix.translation() = cameraPosition;
+                layer.shadowCameraMatrix = cameraMatrix;
+                continue;
+            }
+
+            /* Only across the map, snapping the depth would just move the
+               near and far planes away from the sphere */
+            Vector3 cameraCentre = inverseCameraRotationMatrix*centre;
+            cameraCentre.xy() = Math::floor(cameraCentre.xy()/texelSize + Vector2{0.5f})*texelSize;
+            cameraPosition = cameraRotationMatrix*cameraCentre;
+
+            /* Note we will adjust the near plane later when we render. */
+            layer.orthographicSize = texelSize*Vector2{size};
+            layer.orthographicNear = -radius;
+            layer.orthographicFar = radius;
+
+        } else {
+            /* Calculate the AABB in shadow-camera space */
+            Vector3 min{std::numeric_limits<Float>::max()}, max{std::numeric_limits<Float>::lowest()};
+            for(Vector3 worldPoint: mainCameraFrustumCorners) {
+                Vector3 cameraPoint = inverseCameraRotationMatrix*worldPoint;
+                min = Math::min(min, cameraPoint);
+                max = Math::max(max, cameraPoint);
+            }
+
+            /* Place the shadow camera at the mid-point of the camera box */
+            const Vector3 mid = (min + max)*0.5f;
+            cameraPosition = cameraRotationMatrix*mid;
 
-        /* Place the shadow camera at the mid-point of the camera box */
-        const Vector3 mid = (min + max)*0.5f;
-        const Vector3 cameraPosition = cameraRotationMatrix*mid;
+            const Vector3 range = max - min;
+            /* Set up the initial extends of the shadow map's render volume.
+               Note we will adjust this later when we render. */
+            layer.orthographicSize = range.xy();
+            layer.orthographicNear = -0.5f*range.z();
+            layer.orthographicFar =  0.5f*range.z();
+        }
 
-        const Vector3 range = max - min;
-        /* Set up the initial extends of the shadow map's render volume. Note
-           we will adjust this later when we render. */
-        layer.orthographicSize = range.xy();
-        layer.orthographicNear = -0.5f*range.z();
-        layer.orthographicFar =  0.5f*range.z();
         cameraMatrix.translation() = cameraPosition;
         layer.shadowCameraMatrix = cameraMatrix;
     }
@@ -108,136 +256,559 @@ Float ShadowLight::cutZ(const Int layer) const {
 }
 
 void ShadowLight::setupSplitDistances(const Float zNear, const Float zFar, const Float power) {
+    setupSplitDistances(zNear, zFar, power, {0.0f, 1.0f});
+}
+
+void ShadowLight::setupSplitDistances(const Float zNear, const Float zFar, const Float power, const Vector2& depthRange) {
+    const Float rangeNear = linearDepth(zNear, zFar, depthRange.x());
+    const Float rangeFar = linearDepth(zNear, zFar, depthRange.y());
+
     /* props http://stackoverflow.com/a/33465663 */
+    _nearCutPlane = depthRange.x();
     for(std::size_t i = 0; i != _layers.size(); ++i) {
-        const Float linearDepth = zNear + std::pow(Float(i + 1)/_layers.size(), power)*(zFar - zNear);
-        const Float nonLinearDepth = (zFar + zNear - 2.0f*zNear*zFar/linearDepth)/(zFar - zNear);
-        _layers[i].cutPlane = (nonLinearDepth + 1.0f)/2.0f;
+        const Float layerDepth = rangeNear + std::pow(Float(i + 1)/_layers.size(), power)*(rangeFar - rangeNear);
+        _layers[i].cutPlane = windowDepth(zNear, zFar, layerDepth);
     }
 }
 
 Float ShadowLight::cutDistance(const Float zNear, const Float zFar, const Int layer) const {
-    const Float depthSample = 2.0f*_layers[layer].cutPlane - 1.0f;
-    const Float zLinear = 2.0f*zNear*zFar/(zFar + zNear - depthSample*(zFar - zNear));
-    return zLinear;
+    return linearDepth(zNear, zFar, _layers[layer].cutPlane);
 }
 
-std::vector<Vector3> ShadowLight::layerFrustumCorners(SceneGraph::Camera3D& mainCamera, const Int layer) {
-    const Float z0 = layer == 0 ? 0 : _layers[layer - 1].cutPlane;
+ShadowLight::FrustumCorners ShadowLight::layerFrustumCorners(SceneGraph::Camera3D& mainCamera, const Int layer) {
+    /* The cut planes are in window space, frustum corners take NDC */
+    const Float z0 = layer == 0 ? _nearCutPlane : _layers[layer - 1].cutPlane;
     const Float z1 = _layers[layer].cutPlane;
-    return cameraFrustumCorners(mainCamera, z0, z1);
+    return cameraFrustumCorners(mainCamera, 2.0f*z0 - 1.0f, 2.0f*z1 - 1.0f);
 }
 
-std::vector<Vector3> ShadowLight::cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, const Float z0, const Float z1) {
+ShadowLight::FrustumCorners ShadowLight::cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, const Float z0, const Float z1) {
     const Matrix4 imvp = (mainCamera.projectionMatrix()*mainCamera.cameraMatrix()).inverted();
     return frustumCorners(imvp, z0, z1);
 }
 
-std::vector<Vector3> ShadowLight::frustumCorners(const Matrix4& imvp, const Float z0, const Float z1) {
-    return {imvp.transformPoint({-1,-1, z0}),
+ShadowLight::FrustumCorners ShadowLight::frustumCorners(const Matrix4& imvp, const Float z0, const Float z1) {
+    return {{imvp.transformPoint({-1,-1, z0}),
             imvp.transformPoint({ 1,-1, z0}),
             imvp.transformPoint({-1, 1, z0}),
             imvp.transformPoint({ 1, 1, z0}),
             imvp.transformPoint({-1,-1, z1}),
             imvp.transformPoint({ 1,-1, z1}),
             imvp.transformPoint({-1, 1, z1}),
-            imvp.transformPoint({ 1, 1, z1})};
-}
-
-std::vector<Vector4> ShadowLight::calculateClipPlanes() {
-    const Matrix4 pm = projectionMatrix();
-    std::vector<Vector4> clipPlanes{
-        {pm[3][0] + pm[2][0], pm[3][1] + pm[2][1], pm[3][2] + pm[2][2], pm[3][3] + pm[2][3]},   /* near */
-        {pm[3][0] - pm[2][0], pm[3][1] - pm[2][1], pm[3][2] - pm[2][2], pm[3][3] - pm[2][3]},   /* far */
-        {pm[3][0] + pm[0][0], pm[3][1] + pm[0][1], pm[3][2] + pm[0][2], pm[3][3] + pm[0][3]},   /* left */
-        {pm[3][0] - pm[0][0], pm[3][1] - pm[0][1], pm[3][2] - pm[0][2], pm[3][3] - pm[0][3]},   /* right */
-        {pm[3][0] + pm[1][0], pm[3][1] + pm[1][1], pm[3][2] + pm[1][2], pm[3][3] + pm[1][3]},   /* bottom */
-        {pm[3][0] - pm[1][0], pm[3][1] - pm[1][1], pm[3][2] - pm[1][2], pm[3][3] - pm[1][3]}};  /* top */
+            imvp.transformPoint({ 1, 1, z1})}};
+}
+
+ShadowLight::ClipPlanes ShadowLight::calculateClipPlanes() {
+    return calculateClipPlanes(projectionMatrix());
+}
+
+ShadowLight::ClipPlanes ShadowLight::calculateClipPlanes(const Matrix4& pm) {
+    ClipPlanes clipPlanes{{
+        {pm[0][3] + pm[0][2], pm[1][3] + pm[1][2], pm[2][3] + pm[2][2], pm[3][3] + pm[3][2]},   /* near */
+        {pm[0][3] - pm[0][2], pm[1][3] - pm[1][2], pm[2][3] - pm[2][2], pm[3][3] - pm[3][2]},   /* far */
+        {pm[0][3] + pm[0][0], pm[1][3] + pm[1][0], pm[2][3] + pm[2][0], pm[3][3] + pm[3][0]},   /* left */
+        {pm[0][3] - pm[0][0], pm[1][3] - pm[1][0], pm[2][3] - pm[2][0], pm[3][3] - pm[3][0]},   /* right */
+        {pm[0][3] + pm[0][1], pm[1][3] + pm[1][1], pm[2][3] + pm[2][1], pm[3][3] + pm[3][1]},   /* bottom */
+        {pm[0][3] - pm[0][1], pm[1][3] - pm[1][1], pm[2][3] - pm[2][1], pm[3][3] - pm[3][1]}}}; /* top */
     for(Vector4& plane: clipPlanes)
         plane *= plane.xyz().lengthInverted();
     return clipPlanes;
 }
 
-void ShadowLight::render(SceneGraph::DrawableGroup3D& drawables) {
-    /* Compute transformations of all objects in the group relative to the camera */
-    std::vector<std::reference_wrapper<Object3D>> objects;
-    objects.reserve(drawables.size());
+void ShadowLight::cullCasters(SceneGraph::DrawableGroup3D& drawables) {
+    /* The cascade mask has one bit per layer */
+    CORRADE_INTERNAL_ASSERT(_layers.size() <= 32);
+
+    /* Keep the previous state around to detect moved casters */
+    std::swap(_casterObjects, _previousCasterObjects);
+    std::swap(_casterTransformations, _previousCasterTransformations);
+    std::swap(_casterCascadeMasks, _previousCasterCascadeMasks);
+
+    /* Compute world transformations of all casters just once, not once per
+       layer */
+    _casterObjects.clear();
+    _casterObjects.reserve(drawables.size());
     for(std::size_t i = 0; i != drawables.size(); ++i)
-        objects.push_back(static_cast<Object3D&>(drawables[i].object()));
-    std::vector<ShadowCasterDrawable*> filteredDrawables;
+        _casterObjects.push_back(static_cast<Object3D&>(drawables[i].object()));
+    if(_transformCache) {
+        _casterTransformations.resize(drawables.size());
+        for(std::size_t i = 0; i != drawables.size(); ++i)
+            _casterTransformations[i] = (*_transformCache)[static_cast<ShadowCasterDrawable&>(drawables[i]).transformIndex()];
+    } else _casterTransformations = _object.scene()->transformationMatrices(_casterObjects);
+
+    /* Camera matrices of all layers. This goes through the scene graph, so
+       it can't be done on the workers. */
+    for(ShadowLayerData& d: _layers) {
+        _object.setTransformation(d.shadowCameraMatrix)
+            .setClean();
+        d.cameraMatrix = cameraMatrix();
+    }
 
-    /* Projecting world points normalized device coordinates means they range
-       -1 -> 1. Use this bias matrix so we go straight from world -> texture
-       space */
-    constexpr const Matrix4 bias{{0.5f, 0.0f, 0.0f, 0.0f},
-                                 {0.0f, 0.5f, 0.0f, 0.0f},
-                                 {0.0f, 0.0f, 0.5f, 0.0f},
-                                 {0.5f, 0.5f, 0.5f, 1.0f}};
+    /* Find casters that moved. If the caster set changed, everything needs
+       to be redone. */
+    bool casterSetChanged = _casterObjects.size() != _previousCasterObjects.size();
+    _movedCasters.clear();
+    if(!casterSetChanged) for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex) {
+        if(&_casterObjects[drawableIndex].get() != &_previousCasterObjects[drawableIndex].get()) {
+            casterSetChanged = true;
+            break;
+        }
 
-    Renderer::setDepthMask(true);
+        if(_casterTransformations[drawableIndex] != _previousCasterTransformations[drawableIndex])
+            _movedCasters.push_back(UnsignedInt(drawableIndex));
+    }
+
+    /* The culling is done on the GPU, just compute the clip planes. There
+       are no cascade masks to find out which layers changed. */
+    if(_casterCuller && !_clipmapEnabled) {
+        _casterCuller->setCasters(drawables, {_casterTransformations.data(), _casterTransformations.size()},
+            {_movedCasters.data(), _movedCasters.size()}, casterSetChanged);
+        for(ShadowLayerData& d: _layers) {
+            const ClipPlanes clipPlanes = calculateClipPlanes(
+                Matrix4::orthographicProjection(d.orthographicSize, d.orthographicNear, d.orthographicFar)*d.cameraMatrix);
+            std::copy(clipPlanes.begin(), clipPlanes.end(), d.clipPlanes);
+            d.depthPlane = d.cameraMatrix.row(2);
+            d.casterNear = d.orthographicNear;
+            d.casters.clear();
+        }
+        _casterCascadeMasks.assign(drawables.size(), 0);
+        _changedLayers = ~0u;
+        _bvhValid = false;
+        return;
+    }
+
+    /* If your centre is offset, inject it here */
+    if(_bvhEnabled) {
+        /* Rebuild the hierarchy only if the caster set changed, otherwise
+           just refit the boxes above the moved ones */
+        if(casterSetChanged || !_bvhValid) {
+            _casterBvh.reset(drawables.size());
+            for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex)
+                _casterBvh.set(drawableIndex, _casterTransformations[drawableIndex].translation(),
+                    static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).radius());
+            _casterBvh.build();
+            _bvhValid = true;
+        } else {
+            for(UnsignedInt drawableIndex: _movedCasters)
+                _casterBvh.update(drawableIndex, _casterTransformations[drawableIndex].translation(),
+                    static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).radius());
+            _casterBvh.refit();
+        }
+
+    /* Pack the world-space bounding spheres for the SIMD culler */
+    } else {
+        _casterSpheres.reset(drawables.size());
+        for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex)
+            _casterSpheres.set(drawableIndex, _casterTransformations[drawableIndex].translation(),
+                static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).radius());
+    }
+
+    /* Test the casters against each layer and remember which layers they
+       overlap. Skip the near plane because we need to include shadow
+       casters traveling the direction the camera is facing. If a caster
+       extends in front of the near plane, the near plane gets extended. The
+       layers are independent, so each can be a separate job; a job touches
+       only its own layer and the masks of the thread it runs on. */
+    const std::size_t threadCount = _workerPool ? _workerPool->threadCount() : 1;
+    _threadCasterCascadeMasks.resize(threadCount);
+    for(std::vector<UnsignedInt>& masks: _threadCasterCascadeMasks)
+        masks.assign(drawables.size(), 0);
+    auto cullLayer = [&](const std::size_t layer, const std::size_t thread) {
+        ShadowLayerData& d = _layers[layer];
+        const ClipPlanes clipPlanes = calculateClipPlanes(
+            Matrix4::orthographicProjection(d.orthographicSize, d.orthographicNear, d.orthographicFar)*d.cameraMatrix);
+        std::copy(clipPlanes.begin(), clipPlanes.end(), d.clipPlanes);
+
+        /* Dot product with this gives negated distance along the light
+           direction in the shadow camera space */
+        d.depthPlane = d.cameraMatrix.row(2);
+
+        const UnsignedInt bit = 1u << layer;
+        UnsignedInt* const masks = _threadCasterCascadeMasks[thread].data();
+        d.casterNear = _bvhEnabled ?
+            _casterBvh.cull(d.clipPlanes + 1, 5, d.depthPlane,
+                d.orthographicNear, bit, masks) :
+            _casterSpheres.cull(d.clipPlanes + 1, 5, d.depthPlane,
+                d.orthographicNear, bit, masks);
+
+        /* Draw list of the layer */
+        d.casters.clear();
+        for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex)
+            if(masks[drawableIndex] & bit) d.casters.push_back(UnsignedInt(drawableIndex));
+    };
+    /* Passed by reference so the job function doesn't allocate */
+    if(_workerPool) _workerPool->run(_layers.size(), std::ref(cullLayer));
+    else for(std::size_t layer = 0; layer != _layers.size(); ++layer)
+        cullLayer(layer, 0);
+
+    _casterCascadeMasks.swap(_threadCasterCascadeMasks[0]);
+    for(std::size_t thread = 1; thread != threadCount; ++thread)
+        for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex)
+            _casterCascadeMasks[drawableIndex] |= _threadCasterCascadeMasks[thread][drawableIndex];
+
+    /* Layers touched by casters that moved, appeared or disappeared need to
+       be rendered again */
+    _changedLayers = casterSetChanged ? ~0u : 0;
+    for(UnsignedInt drawableIndex: _movedCasters)
+        _changedLayers |= _casterCascadeMasks[drawableIndex]|_previousCasterCascadeMasks[drawableIndex];
+}
+
+void ShadowLight::render(SceneGraph::DrawableGroup3D& drawables) {
+    cullCasters(drawables);
+    drawCasters(drawables);
+}
+
+void ShadowLight::drawCasters(SceneGraph::DrawableGroup3D& drawables) {
+    if(_clipmapEnabled) {
+        drawClipmapCasters(drawables);
+        return;
+    }
+
+    if(_casterCuller) {
+        drawGpuCulledCasters();
+        return;
+    }
 
+    /* Calculate the projection matrices with near plane extended to the
+       nearest caster (or kept tight if the casters get pancaked onto it) and
+       decide which layers need to be rendered */
+    _layerMatrices.resize(_layers.size());
+    _updatedLayers = 0;
+    _drawCount = 0;
     for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
         ShadowLayerData& d = _layers[layer];
-        Float orthographicNear = d.orthographicNear;
-        const Float orthographicFar = d.orthographicFar;
+        const Matrix4 projectionMatrix = Matrix4::orthographicProjection(d.orthographicSize,
+            _pancakingEnabled ? d.orthographicNear : d.casterNear, d.orthographicFar);
+        const Matrix4 shadowMatrix = ShadowBias*projectionMatrix*d.cameraMatrix;
+
+        if(!_cachingEnabled || shadowMatrix != d.shadowMatrix || (_changedLayers & (1u << layer)))
+            d.dirty = true;
+
+        /* Far layers are updated less often. The layer index is added to the
+           frame counter to spread the updates over different frames. */
+        const UnsignedInt updateInterval = 1u << Math::min(UnsignedInt(layer), _maxUpdateIntervalLog2);
+        if(!d.dirty || (_cachingEnabled && ((_frame + layer) & (updateInterval - 1))))
+            continue;
+
+        /* The layer keeps its previous matrix until it is actually rendered
+           so the receivers always see matching contents */
+        d.dirty = false;
+        d.projectionMatrix = projectionMatrix;
+        d.shadowMatrix = shadowMatrix;
+        d.textureScale = Vector2{layerSize(layer)}/Vector2{_shadowMapSize};
+        _layerMatrices[layer] = projectionMatrix*d.cameraMatrix;
+        _updatedLayers |= 1u << layer;
+    }
+
+    ++_frame;
+    if(!_updatedLayers) return;
+
+    Renderer::setDepthMask(true);
+
+    /* Casters in front of the near plane are flattened onto it */
+    if(_pancakingEnabled) Renderer::enable(Renderer::Feature::DepthClamp);
+
+    /* Footprint of a caster in given layer, in texels across, used to pick
+       its level of detail. In layered mode the caster is drawn just once for
+       all layers in its mask, so the finest of them (i.e., the lowest bit)
+       decides. */
+    for(std::size_t layer = 0; layer != _layers.size(); ++layer)
+        _layers[layer].texelsPerUnit = _lodEnabled ? layerSize(layer).x()/_layers[layer].orthographicSize.x() : Constants::inf();
+    auto casterTexels = [&](const UnsignedInt drawableIndex, const UnsignedInt cascadeMask) {
+        return 2.0f*static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).radius()*
+            _layers[Math::log2(cascadeMask & ~(cascadeMask - 1))].texelsPerUnit;
+    };
+
+    /* Group the casters by mesh and upload their transformations for
+       instanced drawing, either as a single pass for layered rendering or as
+       a pass per layer */
+    if(_batcher) {
+        _batcher->reset();
+        if(_layeredShader) {
+            const UnsignedInt pass = _batcher->addPass();
+            for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex) {
+                const UnsignedInt cascadeMask = _casterCascadeMasks[drawableIndex] & _updatedLayers;
+                if(!cascadeMask) continue;
+                _batcher->add(pass, static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).mesh(casterTexels(drawableIndex, cascadeMask)),
+                    _casterTransformations[drawableIndex], cascadeMask);
+            }
+        } else for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
+            if(!(_updatedLayers & (1u << layer))) continue;
+            ShadowLayerData& d = _layers[layer];
+            d.batcherPass = _batcher->addPass();
+            for(UnsignedInt drawableIndex: d.casters)
+                _batcher->add(d.batcherPass, static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).mesh(casterTexels(drawableIndex, 1u << layer)),
+                    _casterTransformations[drawableIndex], 1u << layer);
+        }
+        _batcher->upload();
+    }
+
+    /* Draw each caster just once, the geometry shader routes it to all updated
+       layers in its cascade mask */
+    if(_layeredShader) {
+        /* Clearing the layered framebuffer would clear all layers */
+        for(std::size_t layer = 0; layer != _layers.size(); ++layer)
+            if(_updatedLayers & (1u << layer))
+                _layers[layer].shadowFramebuffer.clear(FramebufferClear::Depth);
+
+        _layeredFramebuffer.bind();
+        if(_batcher) {
+            _batcher->drawLayered(0, {_layerMatrices.data(), _layerMatrices.size()});
+        } else {
+            _layeredShader->setLayerMatrices({_layerMatrices.data(), _layerMatrices.size()});
+            for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex) {
+                const UnsignedInt cascadeMask = _casterCascadeMasks[drawableIndex] & _updatedLayers;
+                if(!cascadeMask) continue;
+                static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).drawLayered(*_layeredShader,
+                    _casterTransformations[drawableIndex], cascadeMask, casterTexels(drawableIndex, cascadeMask));
+                ++_drawCount;
+            }
+        }
+
+    /* Draw each layer separately */
+    } else for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
+        if(!(_updatedLayers & (1u << layer))) continue;
+        ShadowLayerData& d = _layers[layer];
+
+        d.shadowFramebuffer.setViewport({{}, layerSize(layer)})
+            .clear(FramebufferClear::Depth)
+            .bind();
+
+        if(_batcher) {
+            _batcher->draw(d.batcherPass, _layerMatrices[layer]);
+            continue;
+        }
 
         /* Move this whole object to the right place to render each layer */
         _object.setTransformation(d.shadowCameraMatrix)
             .setClean();
-        setProjectionMatrix(Matrix4::orthographicProjection(d.orthographicSize, orthographicNear, orthographicFar));
-
-        const std::vector<Vector4> clipPlanes = calculateClipPlanes();
-        std::vector<Matrix4> transformations = _object.scene()->transformationMatrices(objects, cameraMatrix());
-
-        /* Rebuild the list of objects we will draw by clipping them with the
-           shadow camera's planes */
-        std::size_t transformationsOutIndex = 0;
-        filteredDrawables.clear();
-        for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex) {
-            auto& drawable = static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]);
-            const Matrix4 transform = transformations[drawableIndex];
-
-            /* If your centre is offset, inject it here */
-            const Vector4 localCentre{0.0f, 0.0f, 0.0f, 1.0f};
-            const Vector4 drawableCentre = transform*localCentre;
-
-            /* Start at 1, not 0 to skip out the near plane because we need to
-               include shadow casters traveling the direction the camera is
-               facing. */
-            for(std::size_t clipPlaneIndex = 1; clipPlaneIndex != clipPlanes.size(); ++clipPlaneIndex) {
-                const Float distance = Math::dot(clipPlanes[clipPlaneIndex], drawableCentre);
-
-                /* If the object is on the useless side of any one plane, we can skip it */
-                if(distance < -drawable.radius())
-                    goto next;
+        setProjectionMatrix(d.projectionMatrix);
+
+        for(UnsignedInt drawableIndex: d.casters)
+            static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).draw(d.cameraMatrix*_casterTransformations[drawableIndex], *this,
+                casterTexels(drawableIndex, 1u << layer));
+        _drawCount += d.casters.size();
+    }
+
+    if(_batcher) _drawCount += _batcher->drawCount();
+
+    if(_pancakingEnabled) Renderer::disable(Renderer::Feature::DepthClamp);
+
+    defaultFramebuffer.bind();
+}
+
+void ShadowLight::drawClipmapCasters(SceneGraph::DrawableGroup3D& drawables) {
+    const Int size = _shadowMapSize.x();
+    const Matrix3x3 inverseRotation = _clipmapRotation.inverted();
+    const bool rotationChanged = _clipmapRotation != _clipmapRenderedRotation;
+    _clipmapRenderedRotation = _clipmapRotation;
+
+    /* Whether the light-space footprint of a caster overlaps given texels of
+       a layer and how many texels across it is */
+    auto overlaps = [&](const UnsignedInt drawableIndex, const ShadowLayerData& d, const Range2Di& region) {
+        const Float radius = static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).radius();
+        const Vector2 centre = (inverseRotation*_casterTransformations[drawableIndex].translation()).xy();
+        const Range2D area{Vector2{region.min()}*d.clipmapTexelSize, Vector2{region.max()}*d.clipmapTexelSize};
+        return centre.x() + radius >= area.left() && centre.x() - radius <= area.right() &&
+               centre.y() + radius >= area.bottom() && centre.y() - radius <= area.top();
+    };
+    auto casterTexels = [&](const UnsignedInt drawableIndex, const ShadowLayerData& d) {
+        return 2.0f*static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).radius()*d.texelsPerUnit;
+    };
+
+    /* Decide which parts of each layer window need to be rendered, in texels
+       of the global grid, and split them where the texture wraps around */
+    _layerMatrices.resize(_layers.size());
+    _clipmapPieces.clear();
+    _updatedLayers = 0;
+    _drawCount = 0;
+    _renderedTexelCount = 0;
+    if(_batcher) _batcher->reset();
+    for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
+        ShadowLayerData& d = _layers[layer];
+        const Float texelSize = d.clipmapTexelSize;
+        const Range2Di window = Range2Di::fromSize(d.clipmapOrigin, Vector2i{size});
+        const Vector2i offset = d.clipmapOrigin - d.clipmapRenderedOrigin;
+
+        /* The receivers always use the full window, only the contents are
+           updated partially */
+        d.projectionMatrix = Matrix4::orthographicProjection(d.orthographicSize,
+            d.orthographicNear, d.orthographicFar);
+        d.shadowMatrix = ShadowBias*d.projectionMatrix*d.cameraMatrix;
+        d.textureScale = Vector2{layerSize(layer)}/Vector2{_shadowMapSize};
+        _layerMatrices[layer] = d.projectionMatrix*d.cameraMatrix;
+        d.texelsPerUnit = _lodEnabled ? 1.0f/texelSize : Constants::inf();
+
+        _clipmapRegions.clear();
+        if(d.dirty || !_cachingEnabled || rotationChanged || _changedLayers == ~0u ||
+           texelSize != d.clipmapRenderedTexelSize ||
+           Math::abs(offset.x()) >= size || Math::abs(offset.y()) >= size) {
+            _clipmapRegions.push_back(window);
+        } else {
+            /* Strips exposed by the window movement. The vertical one spans
+               the whole window height, the horizontal one only the part not
+               covered by the vertical one. */
+            const Int overlapMinX = Math::max(d.clipmapOrigin.x(), d.clipmapRenderedOrigin.x());
+            const Int overlapMaxX = Math::min(d.clipmapOrigin.x(), d.clipmapRenderedOrigin.x()) + size;
+            if(offset.x() > 0)
+                _clipmapRegions.push_back({{overlapMaxX, window.bottom()}, {window.right(), window.top()}});
+            else if(offset.x() < 0)
+                _clipmapRegions.push_back({{window.left(), window.bottom()}, {overlapMinX, window.top()}});
+            if(offset.y() > 0)
+                _clipmapRegions.push_back({{overlapMinX, d.clipmapRenderedOrigin.y() + size}, {overlapMaxX, window.top()}});
+            else if(offset.y() < 0)
+                _clipmapRegions.push_back({{overlapMinX, window.bottom()}, {overlapMaxX, d.clipmapRenderedOrigin.y()}});
+
+            /* Areas around the previous and current footprints of casters that
+               moved in this layer, expanded by a texel for filtering */
+            if(_changedLayers & (1u << layer)) for(UnsignedInt drawableIndex: _movedCasters) {
+                if(!((_casterCascadeMasks[drawableIndex]|_previousCasterCascadeMasks[drawableIndex]) & (1u << layer)))
+                    continue;
+                const Float radius = static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).radius();
+                for(const Matrix4* transformation: {&_casterTransformations[drawableIndex], &_previousCasterTransformations[drawableIndex]}) {
+                    const Vector2 centre = (inverseRotation*transformation->translation()).xy();
+                    const Range2Di footprint{
+                        Math::max(Vector2i{Math::floor((centre - Vector2{radius})/texelSize)} - Vector2i{1}, window.min()),
+                        Math::min(Vector2i{Math::floor((centre + Vector2{radius})/texelSize)} + Vector2i{2}, window.max())};
+                    if(footprint.sizeX() > 0 && footprint.sizeY() > 0)
+                        _clipmapRegions.push_back(footprint);
+                }
             }
 
-            {
-                /* If this object extends in front of the near plane, extend
-                   the near plane. We negate the z because the negative z is
-                   forward away from the camera, but the near/far planes are
-                   measured forwards. */
-                const Float nearestPoint = -drawableCentre.z() - drawable.radius();
-                orthographicNear = Math::min(orthographicNear, nearestPoint);
-                filteredDrawables.push_back(&drawable);
-                transformations[transformationsOutIndex++] = transform;
+            /* Too many small draws cost more than one big, merge them */
+            if(_clipmapRegions.size() > 16) {
+                Range2Di merged = _clipmapRegions.front();
+                for(const Range2Di& region: _clipmapRegions)
+                    merged = {Math::min(merged.min(), region.min()), Math::max(merged.max(), region.max())};
+                _clipmapRegions.assign(1, merged);
             }
+        }
 
-            next:;
+        d.dirty = false;
+        d.clipmapRenderedOrigin = d.clipmapOrigin;
+        d.clipmapRenderedTexelSize = texelSize;
+        if(_clipmapRegions.empty()) continue;
+        _updatedLayers |= 1u << layer;
+
+        /* Camera-space position of the window origin */
+        const Vector2 windowOrigin = -d.orthographicSize*0.5f;
+        for(const Range2Di& region: _clipmapRegions) {
+            /* Split the region at texture boundaries */
+            const Vector2i first = floorDivide(region.min(), size);
+            const Vector2i last = floorDivide(region.max() - Vector2i{1}, size);
+            for(Int y = first.y(); y <= last.y(); ++y) for(Int x = first.x(); x <= last.x(); ++x) {
+                const Range2Di tile = Range2Di::fromSize(Vector2i{x, y}*size, Vector2i{size});
+                ClipmapPiece piece;
+                piece.layer = UnsignedInt(layer);
+                piece.region = {Math::max(region.min(), tile.min()), Math::min(region.max(), tile.max())};
+                if(piece.region.sizeX() <= 0 || piece.region.sizeY() <= 0) continue;
+
+                /* Projection covering just the piece, with the same depth
+                   range as the full window so the depths match */
+                const Vector2 pieceCentre = windowOrigin + Vector2{piece.region.min() + piece.region.max() - 2*d.clipmapOrigin}*0.5f*texelSize;
+                piece.projectionMatrix = Matrix4::orthographicProjection(Vector2{piece.region.size()}*texelSize,
+                    d.orthographicNear, d.orthographicFar)*Matrix4::translation({-pieceCentre, 0.0f});
+
+                /* Casters overlapping the piece */
+                if(_batcher) {
+                    piece.batcherPass = _batcher->addPass();
+                    for(UnsignedInt drawableIndex: d.casters) if(overlaps(drawableIndex, d, piece.region))
+                        _batcher->add(piece.batcherPass, static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).mesh(casterTexels(drawableIndex, d)),
+                            _casterTransformations[drawableIndex], 1u << layer);
+                }
+
+                _renderedTexelCount += piece.region.sizeX()*piece.region.sizeY();
+                _clipmapPieces.push_back(piece);
+            }
         }
+    }
 
-        /* Recalculate the projection matrix with new near plane. */
-        const Matrix4 shadowCameraProjectionMatrix =
-            Matrix4::orthographicProjection(d.orthographicSize, orthographicNear, orthographicFar);
-        d.shadowMatrix = bias*shadowCameraProjectionMatrix*cameraMatrix();
-        setProjectionMatrix(shadowCameraProjectionMatrix);
+    ++_frame;
+    if(_batcher) _batcher->upload();
+    if(_clipmapPieces.empty()) return;
 
+    /* Casters outside of the fixed depth range get flattened onto it */
+    Renderer::setDepthMask(true);
+    Renderer::enable(Renderer::Feature::DepthClamp);
+    Renderer::enable(Renderer::Feature::ScissorTest);
+
+    for(const ClipmapPiece& piece: _clipmapPieces) {
+        ShadowLayerData& d = _layers[piece.layer];
+
+        /* Clear just the piece and render into it */
+        const Range2Di rectangle = Range2Di::fromSize(piece.region.min() - floorDivide(piece.region.min(), size)*size, piece.region.size());
+        d.shadowFramebuffer.setViewport(rectangle);
+        Renderer::setScissor(rectangle);
         d.shadowFramebuffer.clear(FramebufferClear::Depth)
             .bind();
-        for(std::size_t i = 0; i != transformationsOutIndex; ++i)
-            filteredDrawables[i]->draw(transformations[i], *this);
+
+        if(_batcher) {
+            _batcher->draw(piece.batcherPass, piece.projectionMatrix*d.cameraMatrix);
+            continue;
+        }
+
+        _object.setTransformation(d.shadowCameraMatrix)
+            .setClean();
+        setProjectionMatrix(piece.projectionMatrix);
+
+        for(UnsignedInt drawableIndex: d.casters) {
+            if(!overlaps(drawableIndex, d, piece.region)) continue;
+            static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).draw(d.cameraMatrix*_casterTransformations[drawableIndex], *this,
+                casterTexels(drawableIndex, d));
+            ++_drawCount;
+        }
     }
 
+    if(_batcher) _drawCount += _batcher->drawCount();
+
+    for(ShadowLayerData& d: _layers)
+        d.shadowFramebuffer.setViewport({{}, _shadowMapSize});
+    Renderer::disable(Renderer::Feature::ScissorTest);
+    Renderer::disable(Renderer::Feature::DepthClamp);
+
+    defaultFramebuffer.bind();
+}
+
+void ShadowLight::drawGpuCulledCasters() {
+    /* All layers are rendered, with the casters in front of them clamped
+       onto the near plane */
+    _layerMatrices.resize(_layers.size());
+    _casterCullerPlanes.resize(_layers.size()*5);
+    _casterCullerTexelsPerUnit.resize(_layers.size());
+    _updatedLayers = 0;
+    for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
+        ShadowLayerData& d = _layers[layer];
+        d.projectionMatrix = Matrix4::orthographicProjection(d.orthographicSize,
+            d.orthographicNear, d.orthographicFar);
+        d.shadowMatrix = ShadowBias*d.projectionMatrix*d.cameraMatrix;
+        d.textureScale = Vector2{layerSize(layer)}/Vector2{_shadowMapSize};
+        d.texelsPerUnit = _lodEnabled ? layerSize(layer).x()/d.orthographicSize.x() : Constants::inf();
+        d.dirty = false;
+        _layerMatrices[layer] = d.projectionMatrix*d.cameraMatrix;
+        _updatedLayers |= 1u << layer;
+
+        /* Skip the near plane, same as the CPU culling */
+        std::copy(d.clipPlanes + 1, d.clipPlanes + 6, _casterCullerPlanes.begin() + layer*5);
+        _casterCullerTexelsPerUnit[layer] = d.texelsPerUnit;
+    }
+
+    ++_frame;
+    _casterCuller->cull({_casterCullerPlanes.data(), _casterCullerPlanes.size()},
+        {_casterCullerTexelsPerUnit.data(), _casterCullerTexelsPerUnit.size()});
+
+    Renderer::setDepthMask(true);
+    Renderer::enable(Renderer::Feature::DepthClamp);
+
+    for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
+        _layers[layer].shadowFramebuffer.setViewport({{}, layerSize(layer)})
+            .clear(FramebufferClear::Depth)
+            .bind();
+        _casterCuller->draw(layer, _layerMatrices[layer]);
+    }
+    _drawCount = _casterCuller->drawCount();
+
+    Renderer::disable(Renderer::Feature::DepthClamp);
+
     defaultFramebuffer.bind();
 }
 
@@ -30,17 +30,27 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <array>
 #include <Magnum/Framebuffer.h>
 #include <Magnum/Resource.h>
 #include <Magnum/TextureArray.h>
+#include <Magnum/TextureFormat.h>
 #include <Magnum/SceneGraph/Camera.h>
 #include <Magnum/SceneGraph/Drawable.h>
 #include <Magnum/SceneGraph/AbstractFeature.h>
 
+#include "Bvh.h"
+#include "SphereCuller.h"
 #include "Types.h"
 
 namespace Magnum { namespace Examples {
 
+class CasterCuller;
+class ShadowCasterBatcher;
+class ShadowCasterShader;
+class TransformCache;
+class WorkerPool;
+
 /**
 @brief A special camera used to render shadow maps
 
@@ -48,9 +58,15 @@ The object it's attached to should face the direction that the light travels.
 */
 class ShadowLight: public SceneGraph::Camera3D {
     public:
-        static std::vector<Vector3> cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, Float z0 = -1.0f, Float z1 = 1.0f);
+        /** @brief Frustum corners, near plane first */
+        typedef std::array<Vector3, 8> FrustumCorners;
+
+        /** @brief Clip planes, see @ref calculateClipPlanes() for order */
+        typedef std::array<Vector4, 6> ClipPlanes;
+
+        static FrustumCorners cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, Float z0 = -1.0f, Float z1 = 1.0f);
 
-        static std::vector<Vector3> frustumCorners(const Matrix4& imvp, Float z0, Float z1);
+        static FrustumCorners frustumCorners(const Matrix4& imvp, Float z0, Float z1);
 
         explicit ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent);
 
@@ -61,6 +77,86 @@ class ShadowLight: public SceneGraph::Camera3D {
          */
         void setupShadowmaps(Int numShadowLevels, const Vector2i& size);
 
+        /**
+         * @brief Set shadow map storage format
+         *
+         * Takes effect on next @ref setupShadowmaps(). Use
+         * @ref TextureFormat::DepthComponent16 to halve the memory and
+         * bandwidth, preferably together with @ref setPancakingEnabled() so
+         * the depth range stays tight. Default is
+         * @ref TextureFormat::DepthComponent, leaving the precision up to the
+         * driver.
+         */
+        void setShadowmapFormat(TextureFormat format) { _shadowmapFormat = format; }
+
+        TextureFormat shadowmapFormat() const { return _shadowmapFormat; }
+
+        /**
+         * @brief Enable shadow pancaking
+         *
+         * By default the near plane of each layer is extended towards the
+         * light to include the nearest caster, spreading the depth
+         * precision over a larger range. If pancaking is enabled, the near
+         * plane stays tight around the view frustum slice and casters in
+         * front of it are clamped onto it using depth clamping instead.
+         * Disabled by default.
+         */
+        void setPancakingEnabled(bool enabled) { _pancakingEnabled = enabled; }
+
+        bool isPancakingEnabled() const { return _pancakingEnabled; }
+
+        /**
+         * @brief Enable scrolling clipmap layers
+         *
+         * If enabled, each layer is a window into an infinite grid of texels
+         * anchored at the world origin, with fixed orientation and fixed
+         * depth range given by @ref setClipmapDepthRange(). The texture is
+         * addressed toroidally, so when the camera moves, only the newly
+         * exposed strips and the areas around moved casters are rendered,
+         * the rest is kept from previous frames. The receivers have to add
+         * @ref layerWrapOffset() to their shadow map coordinates and rely on
+         * repeat wrapping. Casters outside of the depth range are clamped
+         * onto it. Expects square shadow maps, the screen direction passed to
+         * @ref setTarget() is ignored, as are layered rendering and the
+         * update interval. Disabled by default.
+         */
+        void setClipmapEnabled(bool enabled);
+
+        bool isClipmapEnabled() const { return _clipmapEnabled; }
+
+        /**
+         * @brief Set clipmap depth range
+         *
+         * Distance from the plane going through the world origin,
+         * perpendicular to the light direction, in both directions. Casters
+         * have to be in it, receivers should. Default is @cpp 200.0f @ce.
+         */
+        void setClipmapDepthRange(Float range) { _clipmapDepthRange = range; }
+
+        Float clipmapDepthRange() const { return _clipmapDepthRange; }
+
+        /**
+         * @brief Offset to add to shadow map coordinates of given layer
+         *
+         * Zero if clipmap layers are disabled.
+         */
+        Vector2 layerWrapOffset(Int layer) const;
+
+        /** @brief Count of texels rendered in the last @ref drawCasters() */
+        UnsignedInt renderedTexelCount() const { return _renderedTexelCount; }
+
+        /**
+         * @brief Enable caster level of detail selection
+         *
+         * If enabled, each caster is drawn with the coarsest level of detail
+         * allowed for its footprint in the shadow map, see
+         * @ref ShadowCasterDrawable::setLods(). Otherwise the full detail is
+         * always used. Disabled by default.
+         */
+        void setLodEnabled(bool enabled) { _lodEnabled = enabled; }
+
+        bool isLodEnabled() const { return _lodEnabled; }
+
         /**
          * @brief Set up the distances we should cut the view frustum along
          *
@@ -69,6 +165,20 @@ class ShadowLight: public SceneGraph::Camera3D {
          */
         void setupSplitDistances(Float cameraNear, Float cameraFar, Float power);
 
+        /**
+         * @brief Set up the split distances for a measured depth range
+         * @param cameraNear    Near plane of the camera
+         * @param cameraFar     Far plane of the camera
+         * @param power         Power of the distribution
+         * @param depthRange    Minimal and maximal window-space depth of
+         *      the visible samples, e.g. from @ref DepthReduction
+         *
+         * Like @ref setupSplitDistances(Float, Float, Float), but distributes
+         * the splits only along the range occupied by the scene instead of
+         * the whole camera range.
+         */
+        void setupSplitDistances(Float cameraNear, Float cameraFar, Float power, const Vector2& depthRange);
+
         /**
          * @brief Computes all the matrices for the shadow map splits
          * @param lightDirection    Direction of travel of the light
@@ -84,15 +194,179 @@ class ShadowLight: public SceneGraph::Camera3D {
          */
         void setTarget(const Vector3& lightDirection, const Vector3& screenDirection, SceneGraph::Camera3D& mainCamera);
 
+        /**
+         * @brief Use stable fitting of the layers
+         *
+         * If disabled, each layer is fitted to a bounding box of the view
+         * frustum slice, which gives the best resolution but changes size and
+         * shimmers whenever the camera rotates. If enabled, the slice is
+         * bounded with a sphere, which has the same size regardless of camera
+         * rotation, and its origin is snapped to shadow map texel increments.
+         * Combine with a constant @p screenDirection in @ref setTarget() to
+         * make the layers fully stable. Disabled by default.
+         */
+        void setStableFitting(bool enabled) { _stableFitting = enabled; }
+
+        bool isStableFitting() const { return _stableFitting; }
+
         /**
          * @brief Render a group of shadow-casting drawables to the shadow maps
+         *
+         * Same as calling @ref cullCasters() and @ref drawCasters().
          */
         void render(SceneGraph::DrawableGroup3D& drawables);
 
-        std::vector<Vector3> layerFrustumCorners(SceneGraph::Camera3D& mainCamera, Int layer);
+        /**
+         * @brief Cull the casters against all layers
+         *
+         * First half of @ref render(), doesn't touch any GL state. Useful for
+         * measuring the CPU cost of culling separately.
+         */
+        void cullCasters(SceneGraph::DrawableGroup3D& drawables);
+
+        /**
+         * @brief Draw the culled casters to the layers that need an update
+         *
+         * Second half of @ref render(), expects @ref cullCasters() was
+         * called with the same @p drawables before.
+         */
+        void drawCasters(SceneGraph::DrawableGroup3D& drawables);
+
+        /** @brief Count of draw calls issued in the last @ref drawCasters() */
+        UnsignedInt drawCount() const { return _drawCount; }
+
+        /**
+         * @brief Use layered rendering
+         *
+         * If set to a shader with @ref ShadowCasterShader::Flag::Layered, the
+         * whole texture array is attached to a single framebuffer and each
+         * caster is drawn just once to all layers it overlaps. If set to
+         * @cpp nullptr @ce, each layer is rendered separately. Default is
+         * @cpp nullptr @ce.
+         */
+        void setLayeredShader(ShadowCasterShader* shader) {
+            _layeredShader = shader;
+        }
+
+        bool isLayered() const { return _layeredShader; }
+
+        /**
+         * @brief Use instanced rendering
+         *
+         * If set, the casters are grouped by mesh using @p batcher and drawn
+         * with one instanced draw per mesh and layer (or per mesh only in
+         * layered mode, where the batcher uses its own instanced variant of
+         * the layered shader). All caster meshes have to be registered in the
+         * batcher. If set to @cpp nullptr @ce, each caster is drawn
+         * separately. Default is @cpp nullptr @ce.
+         */
+        void setBatcher(ShadowCasterBatcher* batcher) { _batcher = batcher; }
 
+        ShadowCasterBatcher* batcher() { return _batcher; }
+
+        /**
+         * @brief Take caster transformations from a cache
+         *
+         * If set, world transformations of the casters are taken from
+         * @p cache using @ref ShadowCasterDrawable::transformIndex() instead
+         * of being calculated from the scene graph. The cache is expected to
+         * be updated before @ref render(). Default is @cpp nullptr @ce.
+         */
+        void setTransformCache(const TransformCache* cache) { _transformCache = cache; }
+
+        /**
+         * @brief Enable shadow map caching
+         *
+         * If enabled, a layer is rendered again only if its shadow matrix
+         * changed, if any caster overlapping it moved or if it was
+         * invalidated. Otherwise the previous contents are reused. Enabled by
+         * default.
+         */
+        void setCachingEnabled(bool enabled) { _cachingEnabled = enabled; }
+
+        bool isCachingEnabled() const { return _cachingEnabled; }
+
+        /**
+         * @brief Cull casters using a bounding volume hierarchy
+         *
+         * If enabled, the casters are kept in a @ref Bvh that's rebuilt when
+         * the caster set changes and refitted when some of them move, so
+         * whole groups of casters are rejected at once. Otherwise all casters
+         * are tested one by one. Disabled by default.
+         */
+        void setBvhEnabled(bool enabled) {
+            _bvhEnabled = enabled;
+            _bvhValid = false;
+        }
+
+        bool isBvhEnabled() const { return _bvhEnabled; }
+
+        /**
+         * @brief Cull the layers in parallel
+         *
+         * If set, clip plane extraction, caster culling and building the
+         * caster list of each layer run as one job per layer on @p pool,
+         * each thread marking the casters in its own mask array. Only the
+         * drawing stays on the calling thread. If set to @cpp nullptr @ce,
+         * all layers are culled on the calling thread. Default is
+         * @cpp nullptr @ce.
+         */
+        void setWorkerPool(WorkerPool* pool) { _workerPool = pool; }
+
+        WorkerPool* workerPool() { return _workerPool; }
+
+        /**
+         * @brief Cull the casters on the GPU
+         *
+         * If set, @ref cullCasters() only updates the caster data in
+         * @p culler and @ref drawCasters() culls them against all layers in
+         * a compute shader and draws each layer with a single indirect
+         * multi-draw, without any per-caster work on the CPU. As the nearest
+         * caster isn't known on the CPU, the casters in front of a layer are
+         * always flattened onto its near plane, and as there are no per-caster
+         * cascade masks either, all layers are rendered in every frame.
+         * Ignored for clipmap layers. If set to @cpp nullptr @ce, the casters
+         * are culled on the CPU. Default is @cpp nullptr @ce.
+         */
+        void setCasterCuller(CasterCuller* culler) {
+            _casterCuller = culler;
+            _bvhValid = false;
+        }
+
+        CasterCuller* casterCuller() { return _casterCuller; }
+
+        /**
+         * @brief Set maximal update interval of the layers
+         *
+         * Layer @p i that needs an update is rendered only every
+         * @f$ \min(2^i, m) @f$ frames, where @f$ m @f$ is @p frames rounded
+         * down to a power of two. In the meantime the layer keeps its
+         * previous contents and matrix. Set to @cpp 1 @ce to update all
+         * layers immediately. Has effect only if caching is enabled. Default
+         * is @cpp 1 @ce.
+         */
+        void setMaxUpdateInterval(UnsignedInt frames);
+
+        UnsignedInt maxUpdateInterval() const { return 1u << _maxUpdateIntervalLog2; }
+
+        /** @brief Force all layers to be rendered again in next @ref render() */
+        void invalidate();
+
+        /**
+         * @brief Layers rendered in the last @ref render()
+         *
+         * Bit @p i is set if layer @p i was rendered.
+         */
+        UnsignedInt updatedLayers() const { return _updatedLayers; }
+
+        FrustumCorners layerFrustumCorners(SceneGraph::Camera3D& mainCamera, Int layer);
+
+        /** @brief Window-space depth where given layer ends */
         Float cutZ(Int layer) const;
 
+        /** @brief Window-space depth where the first layer starts */
+        Float nearCutZ() const { return _nearCutPlane; }
+
         Float cutDistance(Float zNear, Float zFar, Int layer) const;
 
         std::size_t layerCount() const { return _layers.size(); }
@@ -101,14 +375,57 @@ class ShadowLight: public SceneGraph::Camera3D {
             return _layers[layer].shadowMatrix;
         }
 
-        std::vector<Vector4> calculateClipPlanes();
+        /**
+         * @brief Set resolution scale of a layer
+         *
+         * The layer is rendered only into the bottom left @p scale part of
+         * its texture layer, which lowers its resolution and rendering cost
+         * without reallocating the texture. The receivers have to multiply
+         * their shadow map coordinates by @ref layerTextureScale(). Reset to
+         * @cpp 1.0f @ce by @ref setupShadowmaps(). Ignored in layered and
+         * clipmap mode.
+         */
+        void setLayerScale(Int layer, Float scale);
+
+        Float layerScale(Int layer) const { return _layers[layer].scale; }
+
+        /**
+         * @brief Shadow map coordinate scale of a layer
+         *
+         * Size of the area the layer was last rendered into relative to the
+         * whole texture layer. Changes together with @ref layerMatrix(), so
+         * until a layer with a new @ref setLayerScale() gets rendered again,
+         * this is still the previous scale. Always @cpp 1.0f @ce in layered
+         * and clipmap mode.
+         */
+        Vector2 layerTextureScale(Int layer) const {
+            return _layers[layer].textureScale;
+        }
+
+        ClipPlanes calculateClipPlanes();
+
+        /**
+         * @brief Calculate normalized clip planes of given matrix
+         *
+         * If @p matrix is a projection matrix, the planes are in camera
+         * space, if it is a combined projection and camera matrix, they are
+         * in world space. Order is near, far, left, right, bottom, top.
+         */
+        static ClipPlanes calculateClipPlanes(const Matrix4& matrix);
+
+        /**
+         * @brief Cascade mask of a shadow caster
+         *
+         * Bit @p i is set if the caster at @p index in the drawable group
+         * passed to the last @ref render() overlaps layer @p i.
+         */
+        UnsignedInt casterCascadeMask(std::size_t index) const {
+            return _casterCascadeMasks[index];
+        }
 
         Texture2DArray& shadowTexture() { return _shadowTexture; }
 
     private:
-        Object3D& _object;
-        Texture2DArray _shadowTexture;
-
         struct ShadowLayerData {
             Framebuffer shadowFramebuffer;
             Matrix4 shadowCameraMatrix;
@@ -116,11 +433,95 @@ class ShadowLight: public SceneGraph::Camera3D {
             Vector2 orthographicSize;
             Float orthographicNear, orthographicFar;
             Float cutPlane;
+            bool dirty{true};
+            Float scale{1.0f};
+            /* Scale of the area the shadow matrix was rendered into */
+            Vector2 textureScale{1.0f};
+
+            /* Culling state, recalculated in every render() */
+            Matrix4 cameraMatrix;
+            Matrix4 projectionMatrix;
+            Vector4 clipPlanes[6];
+            Vector4 depthPlane;
+            Float casterNear;
+            Float texelsPerUnit;
+            std::vector<UnsignedInt> casters;
+            UnsignedInt batcherPass;
+
+            /* Clipmap window origin in texels of the global grid and the
+               texel size, both for the current frame and for what the texture
+               currently contains */
+            Vector2i clipmapOrigin, clipmapRenderedOrigin;
+            Float clipmapTexelSize{}, clipmapRenderedTexelSize{};
 
             explicit ShadowLayerData(const Vector2i& size);
         };
 
+        /* A part of a clipmap layer to render, not wrapping around */
+        struct ClipmapPiece {
+            UnsignedInt layer;
+            /* In global texels */
+            Range2Di region;
+            Matrix4 projectionMatrix;
+            UnsignedInt batcherPass;
+        };
+
+        /* Size of the area the layer is rendered into */
+        Vector2i layerSize(std::size_t layer) const;
+
+        void drawClipmapCasters(SceneGraph::DrawableGroup3D& drawables);
+        void drawGpuCulledCasters();
+
+        Object3D& _object;
+        Texture2DArray _shadowTexture;
+        Framebuffer _layeredFramebuffer;
+        ShadowCasterShader* _layeredShader{};
+        ShadowCasterBatcher* _batcher{};
+        const TransformCache* _transformCache{};
+
         std::vector<ShadowLayerData> _layers;
+        std::vector<Matrix4> _layerMatrices;
+        Vector2i _shadowMapSize;
+        Float _nearCutPlane{};
+        bool _stableFitting{};
+
+        TextureFormat _shadowmapFormat{TextureFormat::DepthComponent};
+        bool _pancakingEnabled{};
+        bool _lodEnabled{};
+
+        bool _cachingEnabled{true};
+        UnsignedInt _maxUpdateIntervalLog2{};
+        UnsignedInt _frame{};
+        UnsignedInt _changedLayers{}, _updatedLayers{};
+        UnsignedInt _drawCount{};
+
+        bool _clipmapEnabled{};
+        Float _clipmapDepthRange{200.0f};
+        Matrix3x3 _clipmapRotation, _clipmapRenderedRotation;
+        std::vector<Range2Di> _clipmapRegions;
+        std::vector<ClipmapPiece> _clipmapPieces;
+        UnsignedInt _renderedTexelCount{};
+
+        /* World transformations and cascade masks of all casters, indexed
+           the same as the drawable group */
+        std::vector<std::reference_wrapper<Object3D>> _casterObjects,
+            _previousCasterObjects;
+        std::vector<Matrix4> _casterTransformations,
+            _previousCasterTransformations;
+        std::vector<UnsignedInt> _casterCascadeMasks,
+            _previousCasterCascadeMasks;
+        std::vector<UnsignedInt> _movedCasters;
+        SphereCuller _casterSpheres;
+        Bvh _casterBvh;
+        bool _bvhEnabled{}, _bvhValid{};
+
+        /* Cascade masks written by each thread, merged afterwards */
+        WorkerPool* _workerPool{};
+        std::vector<std::vector<UnsignedInt>> _threadCasterCascadeMasks;
+
+        CasterCuller* _casterCuller{};
+        std::vector<Vector4> _casterCullerPlanes;
+        std::vector<Float> _casterCullerTexelsPerUnit;
 };
 
 }}
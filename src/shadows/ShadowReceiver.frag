@@ -29,15 +29,122 @@
 */
 
 uniform float shadowBias;
+#ifdef EVSM
+uniform highp sampler2DArray shadowmapMomentsTexture;
+#else
 uniform sampler2DArrayShadow shadowmapTexture;
+#endif
 uniform highp vec3 lightDirection;
 
 in mediump vec3 transformedNormal;
-in highp vec3 shadowCoords[NUM_SHADOW_MAP_LEVELS];
+
+#if defined(CASCADE_FROM_DEPTH) || defined(LOCAL_LIGHTS)
+in highp vec3 worldPosition;
+#endif
+
+#ifdef CASCADE_FROM_DEPTH
+uniform highp mat4 shadowmapMatrix[NUM_SHADOW_MAP_LEVELS];
 uniform float shadowDepthSplits[NUM_SHADOW_MAP_LEVELS];
 
+in highp float viewDepth;
+#else
+in highp vec3 shadowCoords[NUM_SHADOW_MAP_LEVELS];
+#endif
+
+/* Part of each texture layer the level was rendered into */
+uniform highp vec2 shadowmapTextureScales[NUM_SHADOW_MAP_LEVELS];
+
+#ifdef CLIPMAP
+/* Position of the clipmap window origin in the toroidally addressed
+   texture */
+uniform highp vec2 shadowmapWrapOffsets[NUM_SHADOW_MAP_LEVELS];
+#endif
+
+#ifdef LOCAL_LIGHTS
+uniform int localLightCount;
+/* Position in xyz, range in w */
+uniform highp vec4 localLightPositions[MAX_LOCAL_LIGHTS];
+/* Spot direction in xyz, cosine of the cone half-angle in w, -1 for point
+   lights */
+uniform highp vec4 localLightDirections[MAX_LOCAL_LIGHTS];
+/* World to shadow atlas texture space, six for each light. Zero if the light
+   has no tiles. */
+uniform highp mat4 localLightMatrices[MAX_LOCAL_LIGHTS*6];
+uniform sampler2DShadow shadowAtlasTexture;
+
+/* Perspective depth is more precise close to the light, so the bias can be
+   much smaller than for the cascades */
+#define LOCAL_LIGHT_SHADOW_BIAS 0.0002
+
+mediump vec3 localLighting(mediump vec3 normal) {
+    mediump vec3 result = vec3(0.0);
+    for(int i = 0; i < localLightCount; ++i) {
+        highp vec3 toLight = localLightPositions[i].xyz - worldPosition;
+        highp float distance = length(toLight);
+        if(distance >= localLightPositions[i].w) continue;
+
+        mediump vec3 direction = toLight/distance;
+        mediump float intensity = dot(normal, direction);
+        if(intensity <= 0.0) continue;
+
+        /* Quadratic falloff towards the range */
+        mediump float attenuation = 1.0 - distance/localLightPositions[i].w;
+        attenuation *= attenuation;
+
+        /* Spot lights fade out at the cone edge, point lights pick the cube
+           face from the major axis */
+        int face = 0;
+        if(localLightDirections[i].w > -1.0) {
+            mediump float cosine = dot(-direction, localLightDirections[i].xyz);
+            if(cosine <= localLightDirections[i].w) continue;
+            attenuation *= smoothstep(localLightDirections[i].w, mix(localLightDirections[i].w, 1.0, 0.2), cosine);
+        } else {
+            mediump vec3 axis = abs(direction);
+            if(axis.x >= axis.y && axis.x >= axis.z) face = direction.x < 0.0 ? 0 : 1;
+            else if(axis.y >= axis.z) face = direction.y < 0.0 ? 2 : 3;
+            else face = direction.z < 0.0 ? 4 : 5;
+        }
+
+        highp vec4 shadowCoord = localLightMatrices[i*6 + face]*vec4(worldPosition, 1.0);
+        lowp float visibility = 1.0;
+        if(shadowCoord.w > 0.0) {
+            shadowCoord.xyz /= shadowCoord.w;
+            visibility = texture(shadowAtlasTexture, vec3(shadowCoord.xy, shadowCoord.z - LOCAL_LIGHT_SHADOW_BIAS));
+        }
+
+        result += vec3(intensity*attenuation*visibility);
+    }
+
+    return result;
+}
+#endif
+
 out lowp vec4 color;
 
+#ifdef EVSM
+/* Minimal variance relative to the warped depth, avoids artifacts on
+   surfaces facing the light */
+#define EVSM_VARIANCE_BIAS 0.01
+/* Cuts off the low probabilities to reduce light bleeding */
+#define EVSM_LIGHT_BLEEDING_REDUCTION 0.2
+
+lowp float chebyshevUpperBound(highp vec2 moments, highp float depth, highp float exponent) {
+    if(depth <= moments.x) return 1.0;
+
+    highp float depthScale = EVSM_VARIANCE_BIAS*exponent*depth;
+    highp float variance = max(moments.y - moments.x*moments.x, depthScale*depthScale);
+    highp float d = depth - moments.x;
+    lowp float probability = variance/(variance + d*d);
+    return clamp((probability - EVSM_LIGHT_BLEEDING_REDUCTION)/(1.0 - EVSM_LIGHT_BLEEDING_REDUCTION), 0.0, 1.0);
+}
+
+lowp float evsmVisibility(highp vec4 moments, highp float depth) {
+    highp vec2 warped = evsmWarp(depth);
+    return min(chebyshevUpperBound(moments.xy, warped.x, EVSM_POSITIVE_EXPONENT),
+               chebyshevUpperBound(moments.zw, warped.y, EVSM_NEGATIVE_EXPONENT));
+}
+#endif
+
 void main() {
     /* You might want to source this from a texture or a vertex color */
     vec3 albedo = vec3(0.5,0.5,0.5);
@@ -47,6 +154,22 @@ void main() {
 
     mediump vec3 normalizedTransformedNormal = normalize(transformedNormal);
 
+    #ifdef EVSM
+    /* Texture coordinate derivatives for the filtered lookup, taken here as
+       they're undefined in the non-uniform control flow below */
+    #ifdef CASCADE_FROM_DEPTH
+    highp vec3 worldPositionDx = dFdx(worldPosition);
+    highp vec3 worldPositionDy = dFdy(worldPosition);
+    #else
+    highp vec2 shadowCoordsDx[NUM_SHADOW_MAP_LEVELS];
+    highp vec2 shadowCoordsDy[NUM_SHADOW_MAP_LEVELS];
+    for(int i = 0; i < NUM_SHADOW_MAP_LEVELS; ++i) {
+        shadowCoordsDx[i] = dFdx(shadowCoords[i].xy);
+        shadowCoordsDy[i] = dFdy(shadowCoords[i].xy);
+    }
+    #endif
+    #endif
+
     float inverseShadow = 1.0;
 
     /* Is the normal of this face pointing towards the light? */
@@ -62,10 +185,21 @@ void main() {
         int shadowLevel = 0;
         bool inRange;
 
+        #ifdef CASCADE_FROM_DEPTH
+        /* Pick the level from view depth. It should be in range of it, but
+           continue with the next ones in case it isn't. */
+        while(shadowLevel < NUM_SHADOW_MAP_LEVELS - 1 && viewDepth > shadowDepthSplits[shadowLevel])
+            ++shadowLevel;
+        #endif
+
         /* Starting with highest resolution shadow map, find one we're in range
            of */
         for(; shadowLevel < NUM_SHADOW_MAP_LEVELS; ++shadowLevel) {
+            #ifdef CASCADE_FROM_DEPTH
+            vec3 shadowCoord = (shadowmapMatrix[shadowLevel]*vec4(worldPosition, 1.0)).xyz;
+            #else
             vec3 shadowCoord = shadowCoords[shadowLevel];
+            #endif
             inRange = shadowCoord.x >= 0 &&
                       shadowCoord.y >= 0 &&
                       shadowCoord.x <  1 &&
@@ -73,7 +207,25 @@ void main() {
                       shadowCoord.z >= 0 &&
                       shadowCoord.z <  1;
             if(inRange) {
-                inverseShadow = texture(shadowmapTexture, vec4(shadowCoord.xy, shadowLevel, shadowCoord.z-shadowBias));
+                #ifdef CLIPMAP
+                highp vec2 textureCoord = shadowCoord.xy*shadowmapTextureScales[shadowLevel] + shadowmapWrapOffsets[shadowLevel];
+                #else
+                highp vec2 textureCoord = shadowCoord.xy*shadowmapTextureScales[shadowLevel];
+                #endif
+                #ifdef EVSM
+                #ifdef CASCADE_FROM_DEPTH
+                highp vec2 dx = (shadowmapMatrix[shadowLevel]*vec4(worldPositionDx, 0.0)).xy;
+                highp vec2 dy = (shadowmapMatrix[shadowLevel]*vec4(worldPositionDy, 0.0)).xy;
+                #else
+                highp vec2 dx = shadowCoordsDx[shadowLevel];
+                highp vec2 dy = shadowCoordsDy[shadowLevel];
+                #endif
+                highp vec4 moments = textureGrad(shadowmapMomentsTexture, vec3(textureCoord, shadowLevel),
+                    dx*shadowmapTextureScales[shadowLevel], dy*shadowmapTextureScales[shadowLevel]);
+                inverseShadow = evsmVisibility(moments, shadowCoord.z-shadowBias);
+                #else
+                inverseShadow = texture(shadowmapTexture, vec4(textureCoord, shadowLevel, shadowCoord.z-shadowBias));
+                #endif
                 break;
             }
         }
@@ -95,5 +247,8 @@ void main() {
     }
 
     color.rgb = ((ambient + vec3(intensity*inverseShadow))*albedo);
+    #ifdef LOCAL_LIGHTS
+    color.rgb += localLighting(normalizedTransformedNormal)*albedo;
+    #endif
     color.a = 1.0;
 }
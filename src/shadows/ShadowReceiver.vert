@@ -30,22 +30,48 @@
 
 uniform highp mat4 modelMatrix;
 uniform highp mat4 transformationProjectionMatrix;
-uniform highp mat4 shadowmapMatrix[NUM_SHADOW_MAP_LEVELS];
 
 in highp vec4 position;
+
+/* Depth of the receivers has to match the depth pre-pass exactly */
+invariant gl_Position;
 in mediump vec3 normal;
 
 out mediump vec3 transformedNormal;
 
+#if defined(CASCADE_FROM_DEPTH) || defined(LOCAL_LIGHTS)
+out highp vec3 worldPosition;
+#endif
+
+#ifdef CASCADE_FROM_DEPTH
+/* Splits are placed along the main camera, which doesn't have to be the one
+   the receivers are drawn with */
+uniform highp vec4 viewDepthPlane;
+
+out highp float viewDepth;
+#else
+uniform highp mat4 shadowmapMatrix[NUM_SHADOW_MAP_LEVELS];
+
 out highp vec3 shadowCoords[NUM_SHADOW_MAP_LEVELS];
+#endif
 
 void main() {
     transformedNormal = mat3(modelMatrix)*normal;
 
     vec4 worldPos4 = modelMatrix * position;
+    #if defined(CASCADE_FROM_DEPTH) || defined(LOCAL_LIGHTS)
+    worldPosition = worldPos4.xyz;
+    #endif
+
+    #ifndef CASCADE_FROM_DEPTH
     for(int i = 0; i < shadowmapMatrix.length(); i++) {
         shadowCoords[i] = (shadowmapMatrix[i]*worldPos4).xyz;
     }
+    #endif
 
     gl_Position = transformationProjectionMatrix*position;
+
+    #ifdef CASCADE_FROM_DEPTH
+    viewDepth = dot(viewDepthPlane, worldPos4);
+    #endif
 }
@@ -40,8 +40,12 @@ namespace Magnum { namespace Examples {
 ShadowReceiverDrawable::ShadowReceiverDrawable(SceneGraph::AbstractObject3D &object, SceneGraph::DrawableGroup3D* drawables): Drawable{object, drawables} {}
 
 void ShadowReceiverDrawable::draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera) {
+    draw(object().transformationMatrix(), transformationMatrix, camera);
+}
+
+void ShadowReceiverDrawable::draw(const Matrix4& modelMatrix, const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera) {
     _shader->setTransformationProjectionMatrix(camera.projectionMatrix()*transformationMatrix);
-    _shader->setModelMatrix(object().transformationMatrix());
+    _shader->setModelMatrix(modelMatrix);
 
     _mesh->draw(*_shader);
 }
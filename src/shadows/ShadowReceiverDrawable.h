@@ -45,13 +45,37 @@ class ShadowReceiverDrawable: public SceneGraph::Drawable3D {
 
         void draw(const Matrix4 &transformationMatrix, SceneGraph::Camera3D& camera) override;
 
-        void setMesh(Mesh& mesh) { _mesh = &mesh; }
+        /**
+         * @brief Draw with a known world transformation
+         * @param modelMatrix           World transformation of the object
+         * @param transformationMatrix  Transformation relative to the camera
+         * @param camera                Camera
+         */
+        void draw(const Matrix4& modelMatrix, const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera);
+
+        /** @brief Mesh to use for this drawable and its bounding sphere radius */
+        void setMesh(Mesh& mesh, Float radius) {
+            _mesh = &mesh;
+            _radius = radius;
+        }
+
+        Mesh& mesh() { return *_mesh; }
+
+        /** @brief Bounding sphere radius in object space */
+        Float radius() const { return _radius; }
 
         void setShader(ShadowReceiverShader& shader) { _shader = &shader; }
 
+        /** @brief Set index of the object in a @ref TransformCache */
+        void setTransformIndex(UnsignedInt index) { _transformIndex = index; }
+
+        UnsignedInt transformIndex() const { return _transformIndex; }
+
     private:
         Mesh* _mesh{};
+        Float _radius{};
         ShadowReceiverShader* _shader{};
+        UnsignedInt _transformIndex{};
 };
 
 }}
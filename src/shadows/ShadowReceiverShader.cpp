@@ -30,27 +30,93 @@
 
 #include "ShadowReceiverShader.h"
 
+#include <vector>
 #include <Corrade/Utility/Resource.h>
 #include <Magnum/Context.h>
+#include <Magnum/Extensions.h>
+#include <Magnum/OpenGL.h>
 #include <Magnum/Shader.h>
+#include <Magnum/Texture.h>
 #include <Magnum/TextureArray.h>
 #include <Magnum/Version.h>
 #include <Magnum/Math/Matrix4.h>
 
 namespace Magnum { namespace Examples {
 
-ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels) {
+ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels, const Flags flags): ShadowReceiverShader{numShadowLevels, flags, nullptr, 0} {}
+
+ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels, const Flags flags, const Containers::ArrayView<const char> binary, const UnsignedInt binaryFormat): _flags{flags} {
     MAGNUM_ASSERT_VERSION_SUPPORTED(Version::GL330);
 
+    if(binary.empty() || !(_fromBinary = loadBinary(binary, binaryFormat)))
+        compile(numShadowLevels);
+
+    _modelMatrixUniform = uniformLocation("modelMatrix");
+    _transformationProjectionMatrixUniform = uniformLocation("transformationProjectionMatrix");
+    _shadowmapMatrixUniform = uniformLocation("shadowmapMatrix");
+    _lightDirectionUniform = uniformLocation("lightDirection");
+    _shadowBiasUniform = uniformLocation("shadowBias");
+    _shadowDepthSplitsUniform = uniformLocation("shadowDepthSplits");
+    _viewDepthPlaneUniform = uniformLocation("viewDepthPlane");
+    _shadowmapWrapOffsetsUniform = uniformLocation("shadowmapWrapOffsets");
+    _shadowmapTextureScalesUniform = uniformLocation("shadowmapTextureScales");
+    _localLightCountUniform = uniformLocation("localLightCount");
+    _localLightPositionsUniform = uniformLocation("localLightPositions");
+    _localLightDirectionsUniform = uniformLocation("localLightDirections");
+    _localLightMatricesUniform = uniformLocation("localLightMatrices");
+
+    if(_flags & Flag::Evsm)
+        setUniform(uniformLocation("shadowmapMomentsTexture"), ShadowmapMomentsTextureLayer);
+    else
+        setUniform(uniformLocation("shadowmapTexture"), ShadowmapTextureLayer);
+    if(_flags & Flag::LocalLights) {
+        setUniform(uniformLocation("shadowAtlasTexture"), ShadowAtlasTextureLayer);
+        setUniform(_localLightCountUniform, 0);
+    }
+
+    /* Levels use the whole texture layer by default */
+    const std::vector<Vector2> textureScales(numShadowLevels, Vector2{1.0f});
+    setShadowmapTextureScales({textureScales.data(), textureScales.size()});
+}
+
+bool ShadowReceiverShader::loadBinary(const Containers::ArrayView<const char> binary, const UnsignedInt binaryFormat) {
+    if(!Context::current().isExtensionSupported<Extensions::GL::ARB::get_program_binary>())
+        return false;
+
+    glProgramBinary(id(), binaryFormat, binary.data(), binary.size());
+
+    GLint success;
+    glGetProgramiv(id(), GL_LINK_STATUS, &success);
+    return success == GL_TRUE;
+}
+
+std::string ShadowReceiverShader::preamble(const Int numShadowLevels, const Flags flags) {
+    std::string preamble = "#define NUM_SHADOW_MAP_LEVELS " + std::to_string(numShadowLevels) + "\n";
+    if(flags & Flag::CascadeFromDepth)
+        preamble += "#define CASCADE_FROM_DEPTH\n";
+    if(flags & Flag::DebugShadowLevels)
+        preamble += "#define DEBUG_SHADOWMAP_LEVELS\n";
+    if(flags & Flag::Evsm)
+        preamble += "#define EVSM\n";
+    if(flags & Flag::Clipmap)
+        preamble += "#define CLIPMAP\n";
+    if(flags & Flag::LocalLights)
+        preamble += "#define LOCAL_LIGHTS\n#define MAX_LOCAL_LIGHTS " + std::to_string(MaxLocalLights) + "\n";
+    return preamble;
+}
+
+void ShadowReceiverShader::compile(const Int numShadowLevels) {
     const Utility::Resource rs{"shadow-data"};
 
     Shader vert{Version::GL330, Shader::Type::Vertex};
     Shader frag{Version::GL330, Shader::Type::Fragment};
 
-    std::string preamble = "#define NUM_SHADOW_MAP_LEVELS " + std::to_string(numShadowLevels) + "\n";
+    const std::string preamble = ShadowReceiverShader::preamble(numShadowLevels, _flags);
     vert.addSource(preamble);
     vert.addSource(rs.get("ShadowReceiver.vert"));
     frag.addSource(preamble);
+    if(_flags & Flag::Evsm)
+        frag.addSource(rs.get("Evsm.glsl"));
     frag.addSource(rs.get("ShadowReceiver.frag"));
 
     CORRADE_INTERNAL_ASSERT_OUTPUT(Shader::compile({vert, frag}));
@@ -60,15 +126,26 @@ ShadowReceiverShader::ShadowReceiverShader(Int numShadowLevels) {
 
     attachShaders({vert, frag});
 
+    /* Hint the driver that we want to get the binary back for caching */
+    if(Context::current().isExtensionSupported<Extensions::GL::ARB::get_program_binary>())
+        setRetrievableBinary(true);
+
     CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+}
 
-    _modelMatrixUniform = uniformLocation("modelMatrix");
-    _transformationProjectionMatrixUniform = uniformLocation("transformationProjectionMatrix");
-    _shadowmapMatrixUniform = uniformLocation("shadowmapMatrix");
-    _lightDirectionUniform = uniformLocation("lightDirection");
-    _shadowBiasUniform = uniformLocation("shadowBias");
+Containers::Array<char> ShadowReceiverShader::binary(UnsignedInt& binaryFormat) const {
+    if(!Context::current().isExtensionSupported<Extensions::GL::ARB::get_program_binary>())
+        return nullptr;
+
+    GLint size;
+    glGetProgramiv(id(), GL_PROGRAM_BINARY_LENGTH, &size);
+    if(!size) return nullptr;
 
-    setUniform(uniformLocation("shadowmapTexture"), ShadowmapTextureLayer);
+    Containers::Array<char> data{std::size_t(size)};
+    GLenum format;
+    glGetProgramBinary(id(), size, nullptr, &format, data);
+    binaryFormat = format;
+    return data;
 }
 
 ShadowReceiverShader& ShadowReceiverShader::setTransformationProjectionMatrix(const Matrix4& matrix) {
@@ -86,6 +163,26 @@ ShadowReceiverShader& ShadowReceiverShader::setShadowmapMatrices(const Container
     return *this;
 }
 
+ShadowReceiverShader& ShadowReceiverShader::setShadowDepthSplits(const Containers::ArrayView<const Float> splits) {
+    setUniform(_shadowDepthSplitsUniform, splits);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setViewDepthPlane(const Vector4& plane) {
+    setUniform(_viewDepthPlaneUniform, plane);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setShadowmapWrapOffsets(const Containers::ArrayView<const Vector2> offsets) {
+    setUniform(_shadowmapWrapOffsetsUniform, offsets);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setShadowmapTextureScales(const Containers::ArrayView<const Vector2> scales) {
+    setUniform(_shadowmapTextureScalesUniform, scales);
+    return *this;
+}
+
 ShadowReceiverShader& ShadowReceiverShader::setLightDirection(const Vector3& vector) {
     setUniform(_lightDirectionUniform, vector);
     return *this;
@@ -96,6 +193,26 @@ ShadowReceiverShader& ShadowReceiverShader::setShadowmapTexture(Texture2DArray&
     return *this;
 }
 
+ShadowReceiverShader& ShadowReceiverShader::setShadowmapMomentsTexture(Texture2DArray& texture) {
+    texture.bind(ShadowmapMomentsTextureLayer);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setLocalLights(const Containers::ArrayView<const Vector4> positions, const Containers::ArrayView<const Vector4> directions, const Containers::ArrayView<const Matrix4> matrices) {
+    CORRADE_INTERNAL_ASSERT(positions.size() <= MaxLocalLights && directions.size() == positions.size() && matrices.size() == positions.size()*6);
+    setUniform(_localLightCountUniform, Int(positions.size()));
+    if(positions.empty()) return *this;
+    setUniform(_localLightPositionsUniform, positions);
+    setUniform(_localLightDirectionsUniform, directions);
+    setUniform(_localLightMatricesUniform, matrices);
+    return *this;
+}
+
+ShadowReceiverShader& ShadowReceiverShader::setShadowAtlasTexture(Texture2D& texture) {
+    texture.bind(ShadowAtlasTextureLayer);
+    return *this;
+}
+
 ShadowReceiverShader& ShadowReceiverShader::setShadowBias(const Float bias) {
     setUniform(_shadowBiasUniform, bias);
     return *this;
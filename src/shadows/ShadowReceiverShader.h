@@ -30,6 +30,9 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <string>
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/EnumSet.h>
 #include <Magnum/AbstractShaderProgram.h>
 #include <Magnum/Shaders/Generic.h>
 
@@ -41,7 +44,80 @@ class ShadowReceiverShader: public AbstractShaderProgram {
         typedef Shaders::Generic3D::Position Position;
         typedef Shaders::Generic3D::Normal Normal;
 
-        explicit ShadowReceiverShader(Int numShadowLevels);
+        enum class Flag: UnsignedByte {
+            /**
+             * Interpolate only the world position and pick the shadow level
+             * from view depth using @ref setShadowDepthSplits(), instead of
+             * interpolating shadow coordinates for all levels and testing
+             * them one by one. Falls back to the next levels if the position
+             * is out of range of the picked one.
+             */
+            CascadeFromDepth = 1 << 0,
+
+            /** Tint the receivers with a different color for each level */
+            DebugShadowLevels = 1 << 1,
+
+            /**
+             * Exponential variance shadow maps. Instead of comparing with
+             * the depth, the shadow is estimated from a single filtered fetch
+             * from the moments texture set with
+             * @ref setShadowmapMomentsTexture().
+             */
+            Evsm = 1 << 2,
+
+            /**
+             * Spot and point lights with shadows from a @ref ShadowAtlas,
+             * set with @ref setLocalLights() and
+             * @ref setShadowAtlasTexture().
+             */
+            LocalLights = 1 << 3,
+
+            /**
+             * Shadow levels are scrolling clipmaps addressed toroidally,
+             * offset the shadow map coordinates with
+             * @ref setShadowmapWrapOffsets(). See
+             * @ref ShadowLight::setClipmapEnabled().
+             */
+            Clipmap = 1 << 4
+        };
+
+        typedef Containers::EnumSet<Flag> Flags;
+
+        /** @brief Max count of local lights, same as @ref ShadowAtlas::MaxLights */
+        enum: Int { MaxLocalLights = 4 };
+
+        explicit ShadowReceiverShader(Int numShadowLevels, Flags flags = {});
+
+        /**
+         * @brief Construct from a program binary
+         *
+         * Loads a binary previously retrieved with @ref binary() instead of
+         * compiling the sources. If the driver rejects it (for example after
+         * a driver update), the shader is compiled from source as usual,
+         * which can be detected with @ref isFromBinary().
+         */
+        explicit ShadowReceiverShader(Int numShadowLevels, Flags flags, Containers::ArrayView<const char> binary, UnsignedInt binaryFormat);
+
+        /**
+         * @brief Preamble of a variant
+         *
+         * Defines prepended to the sources of the variant, including
+         * constants coming from C++ such as @ref MaxLocalLights.
+         */
+        static std::string preamble(Int numShadowLevels, Flags flags);
+
+        Flags flags() const { return _flags; }
+
+        /** @brief Whether the shader was created from a program binary */
+        bool isFromBinary() const { return _fromBinary; }
+
+        /**
+         * @brief Linked program binary
+         *
+         * Returns an empty array if @extension{ARB,get_program_binary} is not
+         * supported or the driver doesn't provide any binary format.
+         */
+        Containers::Array<char> binary(UnsignedInt& binaryFormat) const;
 
         /**
          * @brief Set transformation and projection matrix
@@ -66,12 +142,73 @@ class ShadowReceiverShader: public AbstractShaderProgram {
          */
         ShadowReceiverShader& setShadowmapMatrices(Containers::ArrayView<const Matrix4> matrices);
 
+        /**
+         * @brief Set shadow depth splits
+         *
+         * View-space distance where each shadow level ends. Used only in
+         * @ref Flag::CascadeFromDepth mode.
+         */
+        ShadowReceiverShader& setShadowDepthSplits(Containers::ArrayView<const Float> splits);
+
+        /**
+         * @brief Set view depth plane
+         *
+         * World-space plane measuring the distance the splits are placed
+         * along, negated third row of the main camera matrix. Used only in
+         * @ref Flag::CascadeFromDepth mode.
+         */
+        ShadowReceiverShader& setViewDepthPlane(const Vector4& plane);
+
+        /**
+         * @brief Set shadow map wrap offsets
+         *
+         * Added to the shadow map coordinates of each level, see
+         * @ref ShadowLight::layerWrapOffset(). Used only in
+         * @ref Flag::Clipmap mode.
+         */
+        ShadowReceiverShader& setShadowmapWrapOffsets(Containers::ArrayView<const Vector2> offsets);
+
+        /**
+         * @brief Set shadow map texture coordinate scales
+         *
+         * Shadow map coordinates of each level are multiplied by these
+         * before the lookup, see @ref ShadowLight::layerTextureScale().
+         * Default is @cpp 1.0f @ce for all levels.
+         */
+        ShadowReceiverShader& setShadowmapTextureScales(Containers::ArrayView<const Vector2> scales);
+
         /** @brief Set world-space direction to the light source */
         ShadowReceiverShader& setLightDirection(const Vector3& vector3);
 
         /** @brief Set shadow map texture array */
         ShadowReceiverShader& setShadowmapTexture(Texture2DArray& texture);
 
+        /**
+         * @brief Set shadow map moments texture array
+         *
+         * Used only in @ref Flag::Evsm mode, see @ref EvsmFilter.
+         */
+        ShadowReceiverShader& setShadowmapMomentsTexture(Texture2DArray& texture);
+
+        /**
+         * @brief Set local lights
+         * @param positions     Positions in XYZ, range in W
+         * @param directions    Spot light direction in XYZ, cosine of the
+         *      cone half-angle in W, -1 for point lights
+         * @param matrices      Six world to shadow atlas texture space
+         *      matrices for each light, zero if the light has no tiles
+         *
+         * Used only in @ref Flag::LocalLights mode.
+         */
+        ShadowReceiverShader& setLocalLights(Containers::ArrayView<const Vector4> positions, Containers::ArrayView<const Vector4> directions, Containers::ArrayView<const Matrix4> matrices);
+
+        /**
+         * @brief Set shadow atlas texture
+         *
+         * Used only in @ref Flag::LocalLights mode.
+         */
+        ShadowReceiverShader& setShadowAtlasTexture(Texture2D& texture);
+
         /**
          * @brief Set thadow bias uniform
          *
@@ -80,15 +217,34 @@ class ShadowReceiverShader: public AbstractShaderProgram {
         ShadowReceiverShader& setShadowBias(Float bias);
 
     private:
-        enum: Int { ShadowmapTextureLayer = 0 };
+        enum: Int {
+            ShadowmapTextureLayer = 0,
+            ShadowmapMomentsTextureLayer = 1,
+            ShadowAtlasTextureLayer = 2
+        };
 
+        bool loadBinary(Containers::ArrayView<const char> binary, UnsignedInt binaryFormat);
+        void compile(Int numShadowLevels);
+
+        Flags _flags;
+        bool _fromBinary{};
         Int _modelMatrixUniform,
             _transformationProjectionMatrixUniform,
             _shadowmapMatrixUniform,
             _lightDirectionUniform,
-            _shadowBiasUniform;
+            _shadowBiasUniform,
+            _shadowDepthSplitsUniform,
+            _viewDepthPlaneUniform,
+            _shadowmapWrapOffsetsUniform,
+            _shadowmapTextureScalesUniform,
+            _localLightCountUniform,
+            _localLightPositionsUniform,
+            _localLightDirectionsUniform,
+            _localLightMatricesUniform;
 };
 
+CORRADE_ENUMSET_OPERATORS(ShadowReceiverShader::Flags)
+
 }}
 
 #endif
@@ -0,0 +1,136 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "ShadowReceiverShaderCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <Corrade/Utility/Debug.h>
+#include <Corrade/Utility/Directory.h>
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/Context.h>
+
+namespace Magnum { namespace Examples {
+
+namespace {
+
+UnsignedLong fnv1a(UnsignedLong hash, const std::string& data) {
+    for(const char c: data) {
+        hash ^= UnsignedByte(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}
+
+ShadowReceiverShaderCache::ShadowReceiverShaderCache(std::string directory): _directory{std::move(directory)} {
+    if(_directory.empty()) return;
+
+    const Utility::Resource rs{"shadow-data"};
+    Context& context = Context::current();
+    _hash = 14695981039346656037ull;
+    for(const std::string& data: {rs.get("ShadowReceiver.vert"), rs.get("ShadowReceiver.frag"),
+        rs.get("Evsm.glsl"), context.rendererString(), context.versionString()})
+        _hash = fnv1a(_hash, data);
+
+    if(!Utility::Directory::mkpath(_directory)) {
+        Warning() << "Can't create shader cache directory" << _directory;
+        _directory = {};
+    }
+}
+
+std::string ShadowReceiverShaderCache::filename(const Key& key) const {
+    const UnsignedLong hash = fnv1a(_hash, ShadowReceiverShader::preamble(key.first,
+        ShadowReceiverShader::Flags(ShadowReceiverShader::Flag(key.second))));
+
+    std::ostringstream out;
+    out << std::hex << hash;
+    return Utility::Directory::join(_directory, "ShadowReceiver-" + out.str() + "-" +
+        std::to_string(key.first) + "-" + std::to_string(key.second) + ".bin");
+}
+
+ShadowReceiverShader& ShadowReceiverShaderCache::get(const Int numShadowLevels, const ShadowReceiverShader::Flags flags) {
+    const Key key{numShadowLevels, UnsignedByte(flags)};
+
+    auto found = _shaders.find(key);
+    if(found != _shaders.end()) return *found->second;
+
+    /* Requested before the queue got to it, no need to compile it again */
+    _pending.erase(std::remove(_pending.begin(), _pending.end(), key), _pending.end());
+
+    std::unique_ptr<ShadowReceiverShader> shader;
+    if(!_directory.empty()) {
+        /* The file is the binary format followed by the binary itself */
+        const std::string file = filename(key);
+        UnsignedInt format{};
+        Containers::Array<char> data;
+        if(Utility::Directory::fileExists(file))
+            data = Utility::Directory::read(file);
+        if(data.size() > sizeof(UnsignedInt)) {
+            std::memcpy(&format, data, sizeof(UnsignedInt));
+            shader.reset(new ShadowReceiverShader{numShadowLevels, flags,
+                data.suffix(sizeof(UnsignedInt)), format});
+        } else shader.reset(new ShadowReceiverShader{numShadowLevels, flags});
+
+        /* Newly compiled, save it for the next time */
+        Containers::Array<char> binary;
+        if(!shader->isFromBinary() && !(binary = shader->binary(format)).empty()) {
+            Containers::Array<char> out{sizeof(UnsignedInt) + binary.size()};
+            std::memcpy(out, &format, sizeof(UnsignedInt));
+            std::memcpy(out + sizeof(UnsignedInt), binary, binary.size());
+            if(!Utility::Directory::write(file, Containers::ArrayView<const void>{out.data(), out.size()}))
+                Warning() << "Can't write shader binary to" << file;
+        }
+
+    } else shader.reset(new ShadowReceiverShader{numShadowLevels, flags});
+
+    return *_shaders.emplace(key, std::move(shader)).first->second;
+}
+
+void ShadowReceiverShaderCache::precompile(const Int numShadowLevels, const ShadowReceiverShader::Flags flags) {
+    const Key key{numShadowLevels, UnsignedByte(flags)};
+    if(_shaders.count(key) || std::find(_pending.begin(), _pending.end(), key) != _pending.end())
+        return;
+
+    _pending.push_back(key);
+}
+
+bool ShadowReceiverShaderCache::compileNext() {
+    if(_pending.empty()) return false;
+
+    const Key key = _pending.front();
+    _pending.pop_front();
+    get(key.first, ShadowReceiverShader::Flags(ShadowReceiverShader::Flag(key.second)));
+    return true;
+}
+
+}}
@@ -0,0 +1,110 @@
+#ifndef Magnum_Examples_ShadowReceiverShaderCache_h
+#define Magnum_Examples_ShadowReceiverShaderCache_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "ShadowReceiverShader.h"
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Cache of @ref ShadowReceiverShader variants
+
+Variants are keyed by shadow level count and flags, so switching between them
+once they are compiled is free. Variants that are likely to be needed can be
+queued with @ref precompile() and compiled one at a time with
+@ref compileNext(), spreading the cost over the first few frames instead of
+stalling when the variant is first requested.
+
+If a cache directory is set, linked program binaries are stored there and
+loaded again on the next run, skipping the compilation entirely. File names
+contain a hash of the shader sources, the preamble of the variant with all
+constants coming from C++ and the GL renderer and version string, so a stale
+binary is never picked up after any of them change. The hash is FNV-1a, which
+unlike `std::hash` gives the same value with any standard library.
+*/
+class ShadowReceiverShaderCache {
+    public:
+        /**
+         * @brief Constructor
+         *
+         * If @p directory is empty, program binaries are not persisted.
+         */
+        explicit ShadowReceiverShaderCache(std::string directory = {});
+
+        /** @brief Variant count */
+        std::size_t size() const { return _shaders.size(); }
+
+        /**
+         * @brief Get a variant
+         *
+         * Loads or compiles the variant if it is not in the cache yet.
+         */
+        ShadowReceiverShader& get(Int numShadowLevels, ShadowReceiverShader::Flags flags = {});
+
+        /**
+         * @brief Queue a variant for compilation
+         *
+         * Does nothing if the variant is already in the cache or queued.
+         */
+        void precompile(Int numShadowLevels, ShadowReceiverShader::Flags flags = {});
+
+        /** @brief Whether there are variants queued for compilation */
+        bool hasPending() const { return !_pending.empty(); }
+
+        /**
+         * @brief Compile next queued variant
+         *
+         * Returns @cpp false @ce if there was nothing left to compile.
+         */
+        bool compileNext();
+
+    private:
+        typedef std::pair<Int, UnsignedByte> Key;
+
+        std::string filename(const Key& key) const;
+
+        std::string _directory;
+        /* FNV-1a of the sources, renderer and version, continued with the
+           preamble of each variant */
+        UnsignedLong _hash{};
+        std::map<Key, std::unique_ptr<ShadowReceiverShader>> _shaders;
+        std::deque<Key> _pending;
+};
+
+}}
+
+#endif
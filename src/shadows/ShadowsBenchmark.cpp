@@ -0,0 +1,409 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <Corrade/Utility/Arguments.h>
+#include <Magnum/Context.h>
+#include <Magnum/Extensions.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Renderer.h>
+#include <Magnum/TimeQuery.h>
+#include <Magnum/Math/Constants.h>
+#include <Magnum/Primitives/Cube.h>
+#include <Magnum/Primitives/Capsule.h>
+#include <Magnum/SceneGraph/Camera.h>
+#include <Magnum/SceneGraph/Drawable.h>
+#include <Magnum/SceneGraph/MatrixTransformation3D.h>
+#include <Magnum/SceneGraph/Scene.h>
+#include <Magnum/Shaders/Phong.h>
+#include <Magnum/Trade/MeshData3D.h>
+#ifdef CORRADE_TARGET_APPLE
+#include <Magnum/Platform/WindowlessCglApplication.h>
+#elif defined(CORRADE_TARGET_WINDOWS)
+#include <Magnum/Platform/WindowlessWglApplication.h>
+#else
+#include <Magnum/Platform/WindowlessGlxApplication.h>
+#endif
+
+#include "CasterCuller.h"
+#include "MeshPool.h"
+#include "ShadowCasterBatcher.h"
+#include "ShadowCasterDrawable.h"
+#include "ShadowCasterShader.h"
+#include "ShadowLight.h"
+#include "TransformCache.h"
+#include "Types.h"
+#include "WorkerPool.h"
+
+/* Counts every heap allocation in the process, including the worker threads,
+   so --check-allocations can verify the shadow frame doesn't allocate */
+namespace { std::atomic<std::size_t> allocationCount{}; }
+
+void* operator new(const std::size_t size) {
+    ++allocationCount;
+    if(void* const data = std::malloc(size ? size : 1)) return data;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* const data) noexcept {
+    std::free(data);
+}
+
+namespace Magnum { namespace Examples {
+
+constexpr const float MainCameraNear = 0.01f;
+constexpr const float MainCameraFar = 100.0f;
+
+using namespace Math::Literals;
+
+/* Headless benchmark of the shadow pass. Renders the shadow maps of seeded
+   random scenes for all combinations of caster count, layer count and shadow
+   map size with a camera moving through the scene, and prints CPU and GPU
+   times of each stage as JSON. */
+class ShadowsBenchmark: public Platform::WindowlessApplication {
+    public:
+        explicit ShadowsBenchmark(const Arguments& arguments);
+
+        int exec() override;
+
+    private:
+        /* Everything that depends on the caster count */
+        struct Scene {
+            explicit Scene(std::size_t casterCount, UnsignedInt seed, ShadowsBenchmark& benchmark);
+
+            Scene3D scene;
+            SceneGraph::DrawableGroup3D casters;
+            TransformCache transformCache;
+            Object3D lightObject{&scene};
+            ShadowLight light{lightObject};
+            Object3D cameraObject{&scene};
+            SceneGraph::Camera3D camera{cameraObject};
+            Float extent;
+        };
+
+        struct Model {
+            MeshPool::Range range;
+            Mesh mesh, instancedMesh;
+            Float radius;
+        };
+
+        void addModel(const Trade::MeshData3D& meshData);
+        void run(Scene& scene, std::size_t layerCount, Int shadowMapSize, std::ostream& out);
+
+        Utility::Arguments _args;
+        UnsignedInt _frames, _warmupFrames;
+        bool _gpuCulling, _verify, _checkAllocations;
+        std::size_t _verifyFailures{}, _allocatingFrames{};
+
+        ShadowCasterShader _shadowCasterShader;
+        ShadowCasterBatcher _shadowCasterBatcher;
+        MeshPool _meshPool;
+        Mesh _pooledInstancedMesh;
+        std::vector<Model> _models;
+        WorkerPool _workerPool;
+        std::unique_ptr<CasterCuller> _casterCuller;
+};
+
+namespace {
+
+std::vector<std::size_t> parseList(const std::string& string) {
+    std::vector<std::size_t> out;
+    std::istringstream in{string};
+    std::size_t value;
+    while(in >> value) out.push_back(value);
+    return out;
+}
+
+std::string escape(const std::string& string) {
+    std::string out;
+    for(const char c: string) {
+        if(c == '"' || c == '\\') out += '\\';
+        if(c >= ' ') out += c;
+    }
+    return out;
+}
+
+/* Mean, median and extremes in milliseconds */
+void writeTimes(std::ostream& out, const char* name, std::vector<Double> times) {
+    std::sort(times.begin(), times.end());
+    Double sum = 0.0;
+    for(const Double time: times) sum += time;
+    out << "\"" << name << "\": {\"mean\": " << sum/times.size()
+        << ", \"median\": " << times[times.size()/2]
+        << ", \"min\": " << times.front()
+        << ", \"max\": " << times.back() << "}";
+}
+
+Double millisecondsSince(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<Double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+ShadowsBenchmark::ShadowsBenchmark(const Arguments& arguments): Platform::WindowlessApplication{arguments} {
+    _args.addOption("casters", "1000 10000 100000").setHelp("casters", "caster counts, space-separated")
+        .addOption("layers", "1 2 4 8").setHelp("layers", "layer counts, space-separated")
+        .addOption("sizes", "1024 2048").setHelp("sizes", "shadow map sizes, space-separated")
+        .addOption("frames", "64").setHelp("frames", "measured frames for each configuration")
+        .addOption("warmup", "8").setHelp("warmup", "frames rendered before measuring")
+        .addOption("seed", "1").setHelp("seed", "random seed of the scenes")
+        .addOption("output").setHelp("output", "JSON output file, standard output if empty")
+        .addBooleanOption("no-instancing").setHelp("no-instancing", "draw the casters one by one")
+        .addBooleanOption("gpu-culling").setHelp("gpu-culling", "cull the casters in a compute shader, needs OpenGL 4.3")
+        .addBooleanOption("cpu-indirect").setHelp("cpu-indirect", "with --gpu-culling, generate the indirect draws on the CPU instead")
+        .addBooleanOption("verify").setHelp("verify", "with --gpu-culling, compare the output of every frame with the CPU and fail on mismatch")
+        .addBooleanOption("check-allocations").setHelp("check-allocations", "fail if any measured frame allocates on the heap")
+        .setHelp("Benchmarks the shadow pass of the shadows example on generated scenes.")
+        .parse(arguments.argc, arguments.argv);
+    _frames = Math::max(_args.value<UnsignedInt>("frames"), 1u);
+    _warmupFrames = _args.value<UnsignedInt>("warmup");
+    _gpuCulling = _args.isSet("gpu-culling");
+    _verify = _gpuCulling && _args.isSet("verify");
+    _checkAllocations = _args.isSet("check-allocations");
+
+    Renderer::enable(Renderer::Feature::DepthTest);
+    Renderer::enable(Renderer::Feature::FaceCulling);
+
+    addModel(Primitives::Cube::solid());
+    addModel(Primitives::Capsule3D::solid(6, 1, 9, 1.0f));
+    _meshPool.upload();
+
+    /* Same setup as the example uses by default */
+    if(Context::current().isExtensionSupported<Extensions::GL::ARB::base_instance>()) {
+        for(Model& model: _models)
+            _shadowCasterBatcher.addMesh(model.mesh, model.instancedMesh, model.range);
+        _pooledInstancedMesh.setPrimitive(MeshPrimitive::Triangles)
+            .addVertexBuffer(_meshPool.vertexBuffer(), 0, ShadowCasterShader::Position{}, Shaders::Phong::Normal{})
+            .addVertexBufferInstanced(_shadowCasterBatcher.instanceBuffer(), 1, 0,
+                ShadowCasterShader::TransformationMatrix{}, ShadowCasterShader::CascadeMask{})
+            .setIndexBuffer(_meshPool.indexBuffer(), 0, Mesh::IndexType::UnsignedInt);
+        if(Context::current().isExtensionSupported<Extensions::GL::ARB::multi_draw_indirect>())
+            _shadowCasterBatcher.setMultiDrawMesh(&_pooledInstancedMesh);
+    }
+
+    if(_gpuCulling) {
+        if(!_shadowCasterBatcher.multiDrawMesh()) {
+            Error() << "GPU culling needs" << Extensions::GL::ARB::multi_draw_indirect::string();
+            std::exit(1);
+        }
+        _casterCuller.reset(new CasterCuller{_shadowCasterBatcher});
+        if(_args.isSet("cpu-indirect")) _casterCuller->setComputeEnabled(false);
+        /* There would be nothing to compare against */
+        if(_verify && !_casterCuller->isComputeEnabled()) {
+            Error() << "Verifying GPU culling needs OpenGL 4.3 and no --cpu-indirect";
+            std::exit(1);
+        }
+        if(!_casterCuller->isComputeEnabled() && !_args.isSet("cpu-indirect"))
+            Warning() << "OpenGL 4.3 not supported, generating the indirect draws on the CPU";
+    }
+}
+
+void ShadowsBenchmark::addModel(const Trade::MeshData3D& meshData) {
+    _models.emplace_back();
+    Model& model = _models.back();
+
+    Float maxMagnitudeSquared = 0.0f;
+    for(const Vector3& position: meshData.positions(0))
+        maxMagnitudeSquared = Math::max(maxMagnitudeSquared, position.dot());
+    model.radius = std::sqrt(maxMagnitudeSquared);
+
+    model.range = _meshPool.add(meshData);
+    model.mesh.setPrimitive(meshData.primitive())
+        .addVertexBuffer(_meshPool.vertexBuffer(), 0, ShadowCasterShader::Position{}, Shaders::Phong::Normal{});
+    _meshPool.setup(model.mesh, model.range);
+    model.instancedMesh.setPrimitive(meshData.primitive())
+        .addVertexBuffer(_meshPool.vertexBuffer(), 0, ShadowCasterShader::Position{}, Shaders::Phong::Normal{})
+        .addVertexBufferInstanced(_shadowCasterBatcher.instanceBuffer(), 1, 0,
+            ShadowCasterShader::TransformationMatrix{}, ShadowCasterShader::CascadeMask{});
+    _meshPool.setup(model.instancedMesh, model.range);
+}
+
+ShadowsBenchmark::Scene::Scene(const std::size_t casterCount, const UnsignedInt seed, ShadowsBenchmark& benchmark) {
+    /* Keep the density the same as in the example, about one caster per ten
+       square units */
+    extent = std::sqrt(casterCount*10.0f);
+
+    std::mt19937 random{seed};
+    std::uniform_real_distribution<Float> horizontal{-extent*0.5f, extent*0.5f};
+    std::uniform_real_distribution<Float> vertical{0.0f, 5.0f};
+    for(std::size_t i = 0; i != casterCount; ++i) {
+        Model& model = benchmark._models[random()%benchmark._models.size()];
+        auto object = new Object3D{&scene};
+        object->setTransformation(Matrix4::translation({horizontal(random), vertical(random), horizontal(random)}));
+
+        auto caster = new ShadowCasterDrawable{*object, &casters};
+        caster->setShader(benchmark._shadowCasterShader);
+        caster->setMesh(model.mesh, model.radius);
+        caster->setTransformIndex(transformCache.add(*object));
+    }
+
+    camera.setProjectionMatrix(Matrix4::perspectiveProjection(35.0_degf, 16.0f/9.0f, MainCameraNear, MainCameraFar));
+    lightObject.setTransformation(Matrix4::lookAt({3.0f, 1.0f, 2.0f}, {}, Vector3::yAxis()));
+    light.setTransformCache(&transformCache);
+    light.setWorkerPool(&benchmark._workerPool);
+
+    /* Every layer is rendered in every frame */
+    light.setCachingEnabled(false);
+}
+
+int ShadowsBenchmark::exec() {
+    std::ofstream file;
+    if(!_args.value("output").empty()) file.open(_args.value("output"));
+    std::ostream& out = file.is_open() ? file : std::cout;
+
+    const bool instanced = !_args.isSet("no-instancing") &&
+        Context::current().isExtensionSupported<Extensions::GL::ARB::base_instance>();
+    out << "{\n  \"renderer\": \"" << escape(Context::current().rendererString())
+        << "\",\n  \"version\": \"" << escape(Context::current().versionString())
+        << "\",\n  \"threads\": " << _workerPool.threadCount()
+        << ",\n  \"instanced\": " << (instanced ? "true" : "false")
+        << ",\n  \"multiDraw\": " << (instanced && _shadowCasterBatcher.multiDrawMesh() ? "true" : "false")
+        << ",\n  \"culling\": \"" << (!_casterCuller ? "cpu" : _casterCuller->isComputeEnabled() ? "gpu" : "cpu-indirect")
+        << "\",\n  \"verified\": " << (_verify ? "true" : "false")
+        << ",\n  \"seed\": " << _args.value("seed")
+        << ",\n  \"frames\": " << _frames
+        << ",\n  \"results\": [";
+
+    bool first = true;
+    for(const std::size_t casterCount: parseList(_args.value("casters"))) {
+        Scene scene{casterCount, _args.value<UnsignedInt>("seed"), *this};
+        scene.light.setBatcher(instanced ? &_shadowCasterBatcher : nullptr);
+        scene.light.setCasterCuller(_casterCuller.get());
+
+        for(const std::size_t layerCount: parseList(_args.value("layers"))) {
+            for(const std::size_t shadowMapSize: parseList(_args.value("sizes"))) {
+                out << (first ? "\n    " : ",\n    ");
+                first = false;
+                run(scene, layerCount, shadowMapSize, out);
+                out.flush();
+            }
+        }
+    }
+
+    out << "\n  ]\n}\n";
+
+    int result = 0;
+    if(_verifyFailures) {
+        Error() << "GPU culling differed from the CPU in" << _verifyFailures << "frames";
+        result = 1;
+    }
+    if(_checkAllocations && _allocatingFrames) {
+        Error() << "The shadow pass allocated on the heap in" << _allocatingFrames << "measured frames";
+        result = 1;
+    }
+    return result;
+}
+
+void ShadowsBenchmark::run(Scene& scene, const std::size_t layerCount, const Int shadowMapSize, std::ostream& out) {
+    scene.light.setupShadowmaps(layerCount, Vector2i{shadowMapSize});
+    scene.light.setupSplitDistances(MainCameraNear, MainCameraFar, 3.0f);
+
+    std::vector<Double> setTargetTimes, cullTimes, submitTimes, gpuTimes;
+    std::vector<TimeQuery> queries;
+    queries.reserve(_frames);
+    UnsignedInt drawCount = 0;
+    std::size_t allocations = 0;
+
+    for(UnsignedInt frame = 0; frame != _warmupFrames + _frames; ++frame) {
+        const bool measured = frame >= _warmupFrames;
+
+        /* Circle around the scene centre, looking along the path */
+        const Rad angle = Rad(Constants::tau()*frame/(_warmupFrames + _frames));
+        const Vector3 position{Math::cos(angle)*scene.extent*0.25f, 3.0f, Math::sin(angle)*scene.extent*0.25f};
+        scene.cameraObject.setTransformation(Matrix4::lookAt(position,
+            position + Vector3{-Math::sin(angle), -0.1f, Math::cos(angle)}, Vector3::yAxis()));
+        scene.transformCache.update();
+
+        /* Only the shadow pass itself, not the bookkeeping around */
+        std::size_t frameAllocations = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+        scene.light.setTarget({3, 2, 3}, scene.cameraObject.transformation()[2].xyz(), scene.camera);
+        const Double setTargetTime = millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        scene.light.cullCasters(scene.casters);
+        const Double cullTime = millisecondsSince(start);
+        frameAllocations = allocationCount - frameAllocations;
+
+        if(measured) {
+            queries.emplace_back(TimeQuery::Target::TimeElapsed);
+            queries.back().begin();
+        }
+        const std::size_t drawAllocations = allocationCount;
+        start = std::chrono::steady_clock::now();
+        scene.light.drawCasters(scene.casters);
+        const Double submitTime = millisecondsSince(start);
+        frameAllocations += allocationCount - drawAllocations;
+        if(!measured) continue;
+        queries.back().end();
+
+        /* Stalls, but only after the query ended */
+        if(_verify && !_casterCuller->verify()) ++_verifyFailures;
+
+        setTargetTimes.push_back(setTargetTime);
+        cullTimes.push_back(cullTime);
+        submitTimes.push_back(submitTime);
+        drawCount += scene.light.drawCount();
+        allocations += frameAllocations;
+        if(frameAllocations) ++_allocatingFrames;
+    }
+
+    /* Waits for the GPU */
+    for(TimeQuery& query: queries)
+        gpuTimes.push_back(query.result<UnsignedLong>()/1.0e6);
+
+    out << "{\"casters\": " << scene.casters.size()
+        << ", \"layers\": " << layerCount
+        << ", \"shadowMapSize\": " << shadowMapSize
+        << ", \"drawsPerFrame\": " << Double(drawCount)/_frames
+        << ", \"allocationsPerFrame\": " << Double(allocations)/_frames << ", ";
+    writeTimes(out, "setTargetMs", setTargetTimes);
+    out << ", ";
+    writeTimes(out, "cullMs", cullTimes);
+    out << ", ";
+    writeTimes(out, "submitMs", submitTimes);
+    out << ", ";
+    writeTimes(out, "gpuMs", gpuTimes);
+    out << "}";
+}
+
+}}
+
+MAGNUM_WINDOWLESSAPPLICATION_MAIN(Magnum::Examples::ShadowsBenchmark)
@@ -28,12 +28,17 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <Corrade/Utility/Directory.h>
 #include <Magnum/Buffer.h>
+#include <Magnum/Context.h>
 #include <Magnum/DefaultFramebuffer.h>
+#include <Magnum/Extensions.h>
 #include <Magnum/Renderer.h>
+#include <Magnum/SampleQuery.h>
 #include <Magnum/Texture.h>
-#include <Magnum/MeshTools/Interleave.h>
-#include <Magnum/MeshTools/CompressIndices.h>
+#include <Magnum/TextureFormat.h>
+#include <Magnum/Math/Constants.h>
 #include <Magnum/Platform/Sdl2Application.h>
 #include <Magnum/Primitives/Cube.h>
 #include <Magnum/Primitives/Capsule.h>
@@ -46,13 +51,26 @@
 #include <Magnum/SceneGraph/MatrixTransformation3D.h>
 #include <Magnum/Trade/MeshData3D.h>
 
+#include "Bvh.h"
+#include "CasterCuller.h"
 #include "DebugLines.h"
+#include "DepthReduction.h"
+#include "EvsmFilter.h"
+#include "FrameArena.h"
+#include "MeshPool.h"
+#include "ShadowAtlas.h"
+#include "ShadowBudget.h"
+#include "ShadowCasterBatcher.h"
 #include "ShadowCasterShader.h"
 #include "ShadowReceiverShader.h"
+#include "ShadowReceiverShaderCache.h"
 #include "ShadowLight.h"
 #include "ShadowCasterDrawable.h"
 #include "ShadowReceiverDrawable.h"
+#include "SphereCuller.h"
+#include "TransformCache.h"
 #include "Types.h"
+#include "WorkerPool.h"
 
 namespace Magnum { namespace Examples {
 
@@ -66,9 +84,16 @@ class ShadowsExample: public Platform::Application {
         explicit ShadowsExample(const Arguments& arguments);
 
     private:
+        struct ModelLod {
+            MeshPool::Range range;
+            Mesh mesh, instancedMesh;
+            Float maxTexels;
+        };
+
         struct Model {
-            Buffer indexBuffer, vertexBuffer;
-            Mesh mesh;
+            /* Full detail first */
+            std::vector<ModelLod> lods;
+            std::vector<ShadowCasterLod> casterLods;
             Float radius;
         };
 
@@ -80,19 +105,57 @@ class ShadowsExample: public Platform::Application {
         void keyReleaseEvent(KeyEvent &event) override;
 
         void addModel(const Trade::MeshData3D& meshData3D);
+        void addModelLod(const Trade::MeshData3D& meshData3D, Float maxTexels);
+        void drawReceivers();
         void renderDebugLines();
         Object3D* createSceneObject(Model& model, bool makeCaster, bool makeReceiver);
-        void recompileReceiverShader(std::size_t numLayers);
+        void setReceiverShader(std::size_t numLayers);
         void setShadowMapSize(const Vector2i& shadowMapSize);
         void setShadowSplitExponent(Float power);
+        void applyShadowBudget();
 
         Scene3D _scene;
         SceneGraph::DrawableGroup3D _shadowCasterDrawables;
         SceneGraph::DrawableGroup3D _shadowReceiverDrawables;
+        TransformCache _transformCache;
         ShadowCasterShader _shadowCasterShader;
-        std::unique_ptr<ShadowReceiverShader> _shadowReceiverShader;
-
+        ShadowCasterShader _layeredShadowCasterShader;
+        ShadowCasterBatcher _shadowCasterBatcher;
+        /* Vertex and index data of all models, the pooled mesh draws all of
+           them instanced with a single multi-draw */
+        MeshPool _meshPool;
+        Mesh _pooledInstancedMesh;
+        ShadowReceiverShaderCache _shadowReceiverShaders;
+        ShadowReceiverShader* _shadowReceiverShader;
+        ShadowReceiverShader::Flags _shadowReceiverShaderFlags;
+
+        /* Receiver culling state, indexed the same as the drawable group */
+        std::vector<Matrix4> _receiverTransformations;
+        std::vector<UnsignedInt> _receiverMasks;
+        std::vector<std::pair<Float, UnsignedInt>> _visibleReceivers;
+        SphereCuller _receiverSpheres;
+        Bvh _receiverBvh;
+        bool _receiverBvhValid{};
+        bool _sortReceivers{true};
+        bool _depthPrePass{};
+
+        /* Samples shaded by the receiver pass, measured every few frames to
+           avoid waiting for the query */
+        SampleQuery _receiverSamplesQuery{SampleQuery::Target::SamplesPassed};
+        bool _receiverSamplesQueryPending{};
+        UnsignedInt _receiverSamples{};
+
+        WorkerPool _workerPool;
+        CasterCuller _casterCuller{_shadowCasterBatcher};
+        /* Temporaries of a single frame, reset at the end of drawEvent() */
+        FrameArena _frameArena;
         DebugLines _debugLines;
+        DepthReduction _depthReduction;
+        EvsmFilter _evsmFilter;
+        ShadowAtlas _shadowAtlas{2048};
+        /* Picks the cascade size, count and format when enabled */
+        ShadowBudget _shadowBudget{256, 2048, 1, 4};
+        bool _shadowBudgetEnabled{};
 
         Object3D _shadowLightObject;
         ShadowLight _shadowLight;
@@ -113,10 +176,13 @@ class ShadowsExample: public Platform::Application {
         Vector2i _shadowMapSize;
         Int _shadowMapFaceCullMode;
         bool _shadowStaticAlignment;
+        bool _depthDrivenSplits{};
 };
 
 ShadowsExample::ShadowsExample(const Arguments& arguments):
     Platform::Application{arguments, Configuration{}.setTitle("Magnum Shadows Example")},
+    _layeredShadowCasterShader{ShadowCasterShader::Flag::Layered},
+    _shadowReceiverShaders{Utility::Directory::join(Utility::Directory::configurationDir("MagnumShadowsExample"), "shader-cache")},
     _shadowLightObject{&_scene},
     _shadowLight{_shadowLightObject},
     _mainCameraObject{&_scene},
@@ -130,15 +196,50 @@ ShadowsExample::ShadowsExample(const Arguments& arguments):
     _shadowStaticAlignment{false}
 {
     _shadowLight.setupShadowmaps(3, _shadowMapSize);
-    _shadowReceiverShader.reset(new ShadowReceiverShader(_shadowLight.layerCount()));
-    _shadowReceiverShader->setShadowBias(_shadowBias);
+    setReceiverShader(_shadowLight.layerCount());
+
+    /* 2048x2048, four layers and driver default depth, estimated at four
+       bytes per texel, fits exactly */
+    _shadowBudget.setMemoryBudget(64*1024*1024);
+    _shadowBudget.setTimeBudget(2.0f);
+
+    /* Compile the variants reachable with F9/F10 and V in the first frames so
+       switching between them doesn't stall later */
+    for(Int numLayers = 1; numLayers <= 8; ++numLayers) {
+        _shadowReceiverShaders.precompile(numLayers, _shadowReceiverShaderFlags);
+        _shadowReceiverShaders.precompile(numLayers, _shadowReceiverShaderFlags ^ ShadowReceiverShader::Flag::CascadeFromDepth);
+    }
 
     Renderer::enable(Renderer::Feature::DepthTest);
     Renderer::enable(Renderer::Feature::FaceCulling);
 
+    /* The capsules get coarser variants for casters that are only a few
+       texels big in the shadow map */
     addModel(Primitives::Cube::solid());
     addModel(Primitives::Capsule3D::solid(1, 1, 4, 1.0f));
+    addModelLod(Primitives::Capsule3D::solid(1, 1, 3, 1.0f), 8.0f);
     addModel(Primitives::Capsule3D::solid(6, 1, 9, 1.0f));
+    addModelLod(Primitives::Capsule3D::solid(3, 1, 6, 1.0f), 32.0f);
+    addModelLod(Primitives::Capsule3D::solid(1, 1, 4, 1.0f), 8.0f);
+
+    /* The meshes don't move anymore, register them for instanced drawing and
+       as caster levels of detail */
+    for(Model& model: _models) {
+        for(std::size_t i = 0; i != model.lods.size(); ++i) {
+            ModelLod& lod = model.lods[i];
+            _shadowCasterBatcher.addMesh(lod.mesh, lod.instancedMesh, lod.range);
+            if(i) model.casterLods.push_back({&lod.mesh, lod.maxTexels});
+        }
+    }
+
+    _meshPool.upload();
+    _pooledInstancedMesh.setPrimitive(MeshPrimitive::Triangles)
+        .addVertexBuffer(_meshPool.vertexBuffer(), 0, ShadowCasterShader::Position{}, Shaders::Phong::Normal{})
+        .addVertexBufferInstanced(_shadowCasterBatcher.instanceBuffer(), 1, 0,
+            ShadowCasterShader::TransformationMatrix{}, ShadowCasterShader::CascadeMask{})
+        .setIndexBuffer(_meshPool.indexBuffer(), 0, Mesh::IndexType::UnsignedInt);
+    if(Context::current().isExtensionSupported<Extensions::GL::ARB::multi_draw_indirect>())
+        _shadowCasterBatcher.setMultiDrawMesh(&_pooledInstancedMesh);
 
     Object3D* ground = createSceneObject(_models[0], false, true);
     ground->setTransformation(Matrix4::scaling({100,1,100}));
@@ -153,6 +254,7 @@ ShadowsExample::ShadowsExample(const Arguments& arguments):
     }
 
     _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
+    _depthReduction.setup(defaultFramebuffer.viewport().size());
 
     _mainCamera.setProjectionMatrix(Matrix4::perspectiveProjection(35.0_degf,
         Vector2{defaultFramebuffer.viewport().size()}.aspectRatio(),
@@ -170,21 +272,43 @@ ShadowsExample::ShadowsExample(const Arguments& arguments):
 
     _shadowLightObject.setTransformation(Matrix4::lookAt(
         {3.0f, 1.0f, 2.0f}, {}, Vector3::yAxis()));
+
+    /* World transformations of casters and receivers are computed just once
+       per frame and shared by both passes */
+    _shadowLight.setTransformCache(&_transformCache);
+
+    /* The layers are culled on all cores */
+    _shadowLight.setWorkerPool(&_workerPool);
+
+    /* A few local lights sharing one shadow atlas, only rendered with the
+       local light receiver shader variant */
+    _shadowAtlas.setTransformCache(&_transformCache);
+    /* Instanced draws need base instance, otherwise the casters are drawn one
+       by one */
+    if(Context::current().isExtensionSupported<Extensions::GL::ARB::base_instance>())
+        _shadowAtlas.setBatcher(&_shadowCasterBatcher);
+    _shadowAtlas.addSpotLight({-8.0f, 6.0f, -8.0f}, Vector3{1.0f, -1.0f, 0.5f}.normalized(), 30.0_degf, 25.0f);
+    _shadowAtlas.addSpotLight({10.0f, 5.0f, -4.0f}, Vector3{-0.5f, -1.0f, -1.0f}.normalized(), 45.0_degf, 20.0f);
+    _shadowAtlas.addPointLight({0.0f, 3.0f, -12.0f}, 12.0f);
 }
 
 Object3D* ShadowsExample::createSceneObject(Model& model, bool makeCaster, bool makeReceiver) {
     auto* object = new Object3D(&_scene);
+    const UnsignedInt transformIndex = _transformCache.add(*object);
 
     if(makeCaster) {
         auto caster = new ShadowCasterDrawable(*object, &_shadowCasterDrawables);
         caster->setShader(_shadowCasterShader);
-        caster->setMesh(model.mesh, model.radius);
+        caster->setMesh(model.lods[0].mesh, model.radius);
+        caster->setLods({model.casterLods.data(), model.casterLods.size()});
+        caster->setTransformIndex(transformIndex);
     }
 
     if(makeReceiver) {
         auto receiver = new ShadowReceiverDrawable(*object, &_shadowReceiverDrawables);
         receiver->setShader(*_shadowReceiverShader);
-        receiver->setMesh(model.mesh);
+        receiver->setMesh(model.lods[0].mesh, model.radius);
+        receiver->setTransformIndex(transformIndex);
     }
 
     return object;
@@ -194,9 +318,6 @@ void ShadowsExample::addModel(const Trade::MeshData3D& meshData3D) {
     _models.emplace_back();
     Model& model = _models.back();
 
-    model.vertexBuffer.setData(MeshTools::interleave(meshData3D.positions(0), meshData3D.normals(0)),
-        BufferUsage::StaticDraw);
-
     Float maxMagnitudeSquared = 0.0f;
     for(Vector3 position: meshData3D.positions(0)) {
         Float magnitudeSquared = position.dot();
@@ -207,16 +328,29 @@ void ShadowsExample::addModel(const Trade::MeshData3D& meshData3D) {
     }
     model.radius = std::sqrt(maxMagnitudeSquared);
 
-    Containers::Array<char> indexData;
-    Mesh::IndexType indexType;
-    UnsignedInt indexStart, indexEnd;
-    std::tie(indexData, indexType, indexStart, indexEnd) = MeshTools::compressIndices(meshData3D.indices());
-    model.indexBuffer.setData(indexData, BufferUsage::StaticDraw);
+    addModelLod(meshData3D, Constants::inf());
+}
 
-    model.mesh.setPrimitive(meshData3D.primitive())
-        .setCount(meshData3D.indices().size())
-        .addVertexBuffer(model.vertexBuffer, 0, Shaders::Phong::Position{}, Shaders::Phong::Normal{})
-        .setIndexBuffer(model.indexBuffer, 0, indexType, indexStart, indexEnd);
+void ShadowsExample::addModelLod(const Trade::MeshData3D& meshData3D, const Float maxTexels) {
+    Model& model = _models.back();
+    model.lods.emplace_back();
+    ModelLod& lod = model.lods.back();
+    lod.maxTexels = maxTexels;
+
+    /* All models share the vertex and index buffers of the pool, the data
+       are uploaded once all are added */
+    lod.range = _meshPool.add(meshData3D);
+
+    lod.mesh.setPrimitive(meshData3D.primitive())
+        .addVertexBuffer(_meshPool.vertexBuffer(), 0, Shaders::Phong::Position{}, Shaders::Phong::Normal{});
+    _meshPool.setup(lod.mesh, lod.range);
+
+    /* Variant for instanced shadow caster drawing */
+    lod.instancedMesh.setPrimitive(meshData3D.primitive())
+        .addVertexBuffer(_meshPool.vertexBuffer(), 0, ShadowCasterShader::Position{}, Shaders::Phong::Normal{})
+        .addVertexBufferInstanced(_shadowCasterBatcher.instanceBuffer(), 1, 0,
+            ShadowCasterShader::TransformationMatrix{}, ShadowCasterShader::CascadeMask{});
+    _meshPool.setup(lod.instancedMesh, lod.range);
 }
 
 void ShadowsExample::drawEvent() {
@@ -227,6 +361,13 @@ void ShadowsExample::drawEvent() {
         redraw();
     }
 
+    _transformCache.update();
+
+    /* Place the splits only along the depth range that was visible in the
+       previous frame */
+    if(_depthDrivenSplits)
+        _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent, _depthReduction.depthRange());
+
     const Vector3 screenDirection = _shadowStaticAlignment ? Vector3::zAxis() : _mainCameraObject.transformation()[2].xyz();
     /* You only really need to do this when your camera moves */
     _shadowLight.setTarget({3, 2, 3}, screenDirection, _mainCamera);
@@ -242,7 +383,28 @@ void ShadowsExample::drawEvent() {
             break;
     }
 
+    /* Local light tiles that changed since last frame */
+    if(_shadowReceiverShaderFlags & ShadowReceiverShader::Flag::LocalLights) {
+        _shadowAtlas.update(_mainCamera);
+        _shadowAtlas.render(_shadowCasterDrawables);
+
+        const std::size_t lightCount = _shadowAtlas.lightCount();
+        const Containers::ArrayView<Vector4> lightPositions = _frameArena.allocate<Vector4>(lightCount);
+        const Containers::ArrayView<Vector4> lightDirections = _frameArena.allocate<Vector4>(lightCount);
+        const Containers::ArrayView<Matrix4> lightMatrices = _frameArena.allocate<Matrix4>(lightCount*6);
+        for(UnsignedInt i = 0; i != lightCount; ++i) {
+            lightPositions[i] = {_shadowAtlas.lightPosition(i), _shadowAtlas.lightRange(i)};
+            lightDirections[i] = {_shadowAtlas.lightDirection(i), _shadowAtlas.lightCutoff(i)};
+            for(UnsignedInt face = 0; face != 6; ++face)
+                lightMatrices[i*6 + face] = _shadowAtlas.tileMatrix(i, face);
+        }
+
+        _shadowReceiverShader->setLocalLights(lightPositions, lightDirections, lightMatrices)
+            .setShadowAtlasTexture(_shadowAtlas.texture());
+    }
+
     /* Create the shadow map textures. */
+    if(_shadowBudgetEnabled) _shadowBudget.begin();
     _shadowLight.render(_shadowCasterDrawables);
 
     switch(_shadowMapFaceCullMode) {
@@ -254,22 +416,172 @@ void ShadowsExample::drawEvent() {
             break;
     }
 
-    Renderer::setClearColor({0.1f, 0.1f, 0.4f, 1.0f});
-    defaultFramebuffer.clear(FramebufferClear::Color|FramebufferClear::Depth);
+    /* Turn the layers that were rendered again into filtered moments. Only
+       after restoring the face culling, the fullscreen triangle would be
+       culled with front faces culled. */
+    if(_shadowReceiverShaderFlags & ShadowReceiverShader::Flag::Evsm) {
+        const Containers::ArrayView<Vector2> layerScales = _frameArena.allocate<Vector2>(_shadowLight.layerCount());
+        for(std::size_t layerIndex = 0; layerIndex != _shadowLight.layerCount(); ++layerIndex)
+            layerScales[layerIndex] = _shadowLight.layerTextureScale(layerIndex);
+
+        _evsmFilter.setWrapEnabled(_shadowLight.isClipmapEnabled());
+        _evsmFilter.filter(_shadowLight.shadowTexture(), _shadowMapSize, _shadowLight.layerCount(), _shadowLight.updatedLayers(), layerScales);
+        _shadowReceiverShader->setShadowmapMomentsTexture(_evsmFilter.moments());
+    }
+    if(_shadowBudgetEnabled) _shadowBudget.end();
 
-    Containers::Array<Matrix4> shadowMatrices{Containers::NoInit, _shadowLight.layerCount()};
-    for(std::size_t layerIndex = 0; layerIndex != _shadowLight.layerCount(); ++layerIndex)
+    /* With depth-driven splits the view is rendered into a framebuffer with a
+       depth texture so it can be reduced afterwards. Only the main camera
+       view, the debug camera has a different depth range; the splits stay
+       where the main camera last saw them. */
+    const bool reduceDepth = _depthDrivenSplits && _activeCamera == &_mainCamera;
+    Renderer::setClearColor({0.1f, 0.1f, 0.4f, 1.0f});
+    if(reduceDepth)
+        _depthReduction.framebuffer().clear(FramebufferClear::Color|FramebufferClear::Depth)
+            .bind();
+    else defaultFramebuffer.clear(FramebufferClear::Color|FramebufferClear::Depth);
+
+    const Containers::ArrayView<Matrix4> shadowMatrices = _frameArena.allocate<Matrix4>(_shadowLight.layerCount());
+    const Containers::ArrayView<Float> shadowDepthSplits = _frameArena.allocate<Float>(_shadowLight.layerCount());
+    const Containers::ArrayView<Vector2> shadowWrapOffsets = _frameArena.allocate<Vector2>(_shadowLight.layerCount());
+    const Containers::ArrayView<Vector2> shadowTextureScales = _frameArena.allocate<Vector2>(_shadowLight.layerCount());
+    for(std::size_t layerIndex = 0; layerIndex != _shadowLight.layerCount(); ++layerIndex) {
         shadowMatrices[layerIndex] = _shadowLight.layerMatrix(layerIndex);
+        shadowDepthSplits[layerIndex] = _shadowLight.cutDistance(MainCameraNear, MainCameraFar, layerIndex);
+        shadowWrapOffsets[layerIndex] = _shadowLight.layerWrapOffset(layerIndex);
+        shadowTextureScales[layerIndex] = _shadowLight.layerTextureScale(layerIndex);
+    }
 
     _shadowReceiverShader->setShadowmapMatrices(shadowMatrices)
+        .setShadowDepthSplits(shadowDepthSplits)
+        .setViewDepthPlane(-_mainCamera.cameraMatrix().row(2))
+        .setShadowmapWrapOffsets(shadowWrapOffsets)
+        .setShadowmapTextureScales(shadowTextureScales)
         .setShadowmapTexture(_shadowLight.shadowTexture())
         .setLightDirection(_shadowLightObject.transformation().backward());
 
-    _activeCamera->draw(_shadowReceiverDrawables);
+    drawReceivers();
+
+    /* The default framebuffer depth isn't written, clear it for anything
+       drawn on top */
+    if(reduceDepth) {
+        _depthReduction.reduce();
+        AbstractFramebuffer::blit(_depthReduction.framebuffer(), defaultFramebuffer,
+            defaultFramebuffer.viewport(), FramebufferBlit::Color);
+        defaultFramebuffer.clear(FramebufferClear::Depth);
+    }
 
     renderDebugLines();
 
     swapBuffers();
+    _frameArena.reset();
+
+    /* The new configuration is used from the next frame on */
+    if(_shadowBudgetEnabled && _shadowBudget.update()) {
+        applyShadowBudget();
+        redraw();
+    }
+
+    /* One queued receiver shader variant per frame */
+    if(_shadowReceiverShaders.compileNext()) redraw();
+}
+
+void ShadowsExample::drawReceivers() {
+    const Matrix4 cameraMatrix = _activeCamera->cameraMatrix();
+    const std::size_t receiverCount = _shadowReceiverDrawables.size();
+
+    /* The receivers share the caster culling mode. The hierarchy is rebuilt
+       if the receiver set changed, otherwise only the receivers that moved
+       are refitted. */
+    const bool useBvh = _shadowLight.isBvhEnabled();
+    const bool rebuildBvh = useBvh && (!_receiverBvhValid || _receiverTransformations.size() != receiverCount);
+    if(!useBvh) _receiverSpheres.reset(receiverCount);
+    else if(rebuildBvh) _receiverBvh.reset(receiverCount);
+    _receiverTransformations.resize(receiverCount);
+
+    for(std::size_t i = 0; i != receiverCount; ++i) {
+        auto& drawable = static_cast<ShadowReceiverDrawable&>(_shadowReceiverDrawables[i]);
+        const Matrix4& modelMatrix = _transformCache[drawable.transformIndex()];
+        if(useBvh && !rebuildBvh && modelMatrix == _receiverTransformations[i])
+            continue;
+        _receiverTransformations[i] = modelMatrix;
+
+        /* Scaling the object scales the bounding sphere as well, the ground
+           is scaled a lot */
+        const Float scale = std::sqrt(Math::max(modelMatrix[0].xyz().dot(),
+            Math::max(modelMatrix[1].xyz().dot(), modelMatrix[2].xyz().dot())));
+        const Vector3 centre = modelMatrix.translation();
+        const Float radius = drawable.radius()*scale;
+        if(!useBvh) _receiverSpheres.set(i, centre, radius);
+        else if(rebuildBvh) _receiverBvh.set(i, centre, radius);
+        else _receiverBvh.update(i, centre, radius);
+    }
+
+    if(rebuildBvh) {
+        _receiverBvh.build();
+        _receiverBvhValid = true;
+    } else if(useBvh) _receiverBvh.refit();
+
+    /* Test against the camera frustum */
+    const ShadowLight::ClipPlanes clipPlanes = ShadowLight::calculateClipPlanes(_activeCamera->projectionMatrix()*cameraMatrix);
+    const Vector4 depthPlane = cameraMatrix.row(2);
+    _receiverMasks.assign(receiverCount, 0);
+    if(useBvh)
+        _receiverBvh.cull(clipPlanes.data(), clipPlanes.size(), depthPlane, 0.0f, 1, _receiverMasks.data());
+    else
+        _receiverSpheres.cull(clipPlanes.data(), clipPlanes.size(), depthPlane, 0.0f, 1, _receiverMasks.data());
+
+    /* Draw the visible ones front to back to reduce overdraw of the
+       expensive shadow lookups */
+    _visibleReceivers.clear();
+    for(std::size_t i = 0; i != receiverCount; ++i) {
+        if(!_receiverMasks[i]) continue;
+        const Float depth = -(Math::dot(depthPlane.xyz(), _receiverTransformations[i].translation()) + depthPlane.w());
+        _visibleReceivers.emplace_back(depth, UnsignedInt(i));
+    }
+    if(_sortReceivers)
+        std::sort(_visibleReceivers.begin(), _visibleReceivers.end());
+
+    /* Lay down the depth first using the position-only caster shader, then
+       shade only the fragments that ended up visible. The matrix has to be
+       calculated the same way as in ShadowReceiverDrawable::draw(). */
+    if(_depthPrePass) {
+        Renderer::setColorMask(false, false, false, false);
+        for(const std::pair<Float, UnsignedInt>& visible: _visibleReceivers) {
+            auto& drawable = static_cast<ShadowReceiverDrawable&>(_shadowReceiverDrawables[visible.second]);
+            const Matrix4& modelMatrix = _receiverTransformations[visible.second];
+            _shadowCasterShader.setTransformationMatrix(_activeCamera->projectionMatrix()*(cameraMatrix*modelMatrix));
+            drawable.mesh().draw(_shadowCasterShader);
+        }
+        Renderer::setColorMask(true, true, true, true);
+        Renderer::setDepthFunction(Renderer::DepthFunction::Equal);
+        Renderer::setDepthMask(false);
+    }
+
+    /* Pick up the result of the previous measurement if it's ready, start a
+       new one otherwise */
+    const bool measure = !_receiverSamplesQueryPending || _receiverSamplesQuery.resultAvailable();
+    if(measure) {
+        if(_receiverSamplesQueryPending)
+            _receiverSamples = _receiverSamplesQuery.result<UnsignedInt>();
+        _receiverSamplesQuery.begin();
+    }
+
+    for(const std::pair<Float, UnsignedInt>& visible: _visibleReceivers) {
+        auto& drawable = static_cast<ShadowReceiverDrawable&>(_shadowReceiverDrawables[visible.second]);
+        const Matrix4& modelMatrix = _receiverTransformations[visible.second];
+        drawable.draw(modelMatrix, cameraMatrix*modelMatrix, *_activeCamera);
+    }
+
+    if(measure) {
+        _receiverSamplesQuery.end();
+        _receiverSamplesQueryPending = true;
+    }
+
+    if(_depthPrePass) {
+        Renderer::setDepthFunction(Renderer::DepthFunction::Less);
+        Renderer::setDepthMask(true);
+    }
 }
 
 void ShadowsExample::renderDebugLines() {
@@ -288,9 +600,11 @@ void ShadowsExample::renderDebugLines() {
         const Deg hue = layerIndex*360.0_degf/_shadowLight.layerCount();
         _debugLines.addFrustum((unbiasMatrix*layerMatrix).inverted(),
             Color3::fromHSV(hue, 1.0f, 0.5f));
+        const Float z0 = layerIndex == 0 ? _shadowLight.nearCutZ() : _shadowLight.cutZ(layerIndex - 1);
+        const Float z1 = _shadowLight.cutZ(layerIndex);
         _debugLines.addFrustum(imvp,
             Color3::fromHSV(hue, 1.0f, 1.0f),
-            layerIndex == 0 ? 0 : _shadowLight.cutZ(layerIndex - 1), _shadowLight.cutZ(layerIndex));
+            2.0f*z0 - 1.0f, 2.0f*z1 - 1.0f);
     }
 
     _debugLines.draw(_activeCamera->projectionMatrix()*_activeCamera->cameraMatrix());
@@ -381,7 +695,7 @@ void ShadowsExample::keyPressEvent(KeyEvent& event) {
         std::size_t numLayers = _shadowLight.layerCount() - 1;
         if(numLayers >= 1) {
             _shadowLight.setupShadowmaps(numLayers, _shadowMapSize);
-            recompileReceiverShader(numLayers);
+            setReceiverShader(numLayers);
             _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
             Debug() << "Shadow map size" << _shadowMapSize << "x" << _shadowLight.layerCount() << "layers";
         } else return;
@@ -390,7 +704,7 @@ void ShadowsExample::keyPressEvent(KeyEvent& event) {
         std::size_t numLayers = _shadowLight.layerCount() + 1;
         if(numLayers <= 32) {
             _shadowLight.setupShadowmaps(numLayers, _shadowMapSize);
-            recompileReceiverShader(numLayers);
+            setReceiverShader(numLayers);
             _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
             Debug() << "Shadow map size" << _shadowMapSize << "x" << _shadowLight.layerCount() << "layers";
         } else return;
@@ -401,6 +715,161 @@ void ShadowsExample::keyPressEvent(KeyEvent& event) {
     } else if(event.key() == KeyEvent::Key::F12) {
         setShadowMapSize(_shadowMapSize*2);
 
+    } else if(event.key() == KeyEvent::Key::G) {
+        _shadowLight.setLodEnabled(!_shadowLight.isLodEnabled());
+        Debug() << "Shadow caster level of detail:"
+            << (_shadowLight.isLodEnabled() ? "by footprint in the layer" : "full detail");
+
+    } else if(event.key() == KeyEvent::Key::X) {
+        _shadowLight.setShadowmapFormat(_shadowLight.shadowmapFormat() == TextureFormat::DepthComponent16 ?
+            TextureFormat::DepthComponent : TextureFormat::DepthComponent16);
+        _shadowLight.setupShadowmaps(_shadowLight.layerCount(), _shadowMapSize);
+        _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
+        Debug() << "Shadow map depth:"
+            << (_shadowLight.shadowmapFormat() == TextureFormat::DepthComponent16 ? "16-bit" : "driver default");
+
+    } else if(event.key() == KeyEvent::Key::K) {
+        _shadowLight.setPancakingEnabled(!_shadowLight.isPancakingEnabled());
+        Debug() << "Shadow caster pancaking:"
+            << (_shadowLight.isPancakingEnabled() ? "on" : "off");
+
+    } else if(event.key() == KeyEvent::Key::L) {
+        _shadowLight.setLayeredShader(_shadowLight.isLayered() ? nullptr : &_layeredShadowCasterShader);
+        Debug() << "Shadow map rendering:"
+            << (_shadowLight.isLayered() ? "all layers at once" : "layer by layer");
+
+    } else if(event.key() == KeyEvent::Key::S) {
+        _shadowLight.setStableFitting(!_shadowLight.isStableFitting());
+        Debug() << "Shadow layer fitting:"
+            << (_shadowLight.isStableFitting() ? "stable" : "tight");
+
+    } else if(event.key() == KeyEvent::Key::D) {
+        _depthDrivenSplits = !_depthDrivenSplits;
+        if(!_depthDrivenSplits)
+            _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
+        Debug() << "Shadow splits:"
+            << (_depthDrivenSplits ? "along visible depth range" : "along whole camera range");
+
+    } else if(event.key() == KeyEvent::Key::I) {
+        if(!Context::current().isExtensionSupported<Extensions::GL::ARB::base_instance>()) {
+            Debug() << "Instanced shadow casters need" << Extensions::GL::ARB::base_instance::string();
+            return;
+        }
+
+        _shadowLight.setBatcher(_shadowLight.batcher() ? nullptr : &_shadowCasterBatcher);
+        Debug() << "Shadow casters:"
+            << (_shadowLight.batcher() ? "instanced, grouped by mesh" : "drawn one by one");
+
+    } else if(event.key() == KeyEvent::Key::M) {
+        if(!Context::current().isExtensionSupported<Extensions::GL::ARB::multi_draw_indirect>()) {
+            Debug() << "Multi-draw shadow casters need" << Extensions::GL::ARB::multi_draw_indirect::string();
+            return;
+        }
+
+        _shadowCasterBatcher.setMultiDrawMesh(_shadowCasterBatcher.multiDrawMesh() ? nullptr : &_pooledInstancedMesh);
+        /* GPU culling can't do without */
+        if(!_shadowCasterBatcher.multiDrawMesh()) _shadowLight.setCasterCuller(nullptr);
+        Debug() << "Instanced shadow casters:"
+            << (_shadowCasterBatcher.multiDrawMesh() ? "one indirect multi-draw per pass" : "one draw per mesh");
+
+    } else if(event.key() == KeyEvent::Key::Q) {
+        if(!Context::current().isExtensionSupported<Extensions::GL::ARB::multi_draw_indirect>()) {
+            Debug() << "GPU-driven shadow casters need" << Extensions::GL::ARB::multi_draw_indirect::string();
+            return;
+        }
+
+        _shadowLight.setCasterCuller(_shadowLight.casterCuller() ? nullptr : &_casterCuller);
+        if(_shadowLight.casterCuller())
+            _shadowCasterBatcher.setMultiDrawMesh(&_pooledInstancedMesh);
+        if(!_shadowLight.casterCuller())
+            Debug() << "Shadow caster culling: on the CPU";
+        else if(_casterCuller.isComputeEnabled())
+            Debug() << "Shadow caster culling: in a compute shader, drawn indirectly";
+        else Debug() << "Shadow caster culling: on the CPU, drawn indirectly (no OpenGL 4.3)";
+
+    } else if(event.key() == KeyEvent::Key::V) {
+        _shadowReceiverShaderFlags ^= ShadowReceiverShader::Flag::CascadeFromDepth;
+        setReceiverShader(_shadowLight.layerCount());
+        Debug() << "Shadow level selection:"
+            << (_shadowReceiverShaderFlags & ShadowReceiverShader::Flag::CascadeFromDepth ? "from view depth" : "first one in range");
+
+    } else if(event.key() == KeyEvent::Key::E) {
+        _shadowReceiverShaderFlags ^= ShadowReceiverShader::Flag::Evsm;
+        setReceiverShader(_shadowLight.layerCount());
+        _evsmFilter.invalidate();
+        Debug() << "Shadow filtering:"
+            << (_shadowReceiverShaderFlags & ShadowReceiverShader::Flag::Evsm ? "exponential variance shadow maps" : "depth comparison");
+
+    } else if(event.key() == KeyEvent::Key::A) {
+        _shadowReceiverShaderFlags ^= ShadowReceiverShader::Flag::LocalLights;
+        setReceiverShader(_shadowLight.layerCount());
+        _shadowAtlas.invalidate();
+        Debug() << "Local shadowed lights:"
+            << (_shadowReceiverShaderFlags & ShadowReceiverShader::Flag::LocalLights ? "on" : "off");
+
+    } else if(event.key() == KeyEvent::Key::R) {
+        _shadowLight.setClipmapEnabled(!_shadowLight.isClipmapEnabled());
+        _shadowReceiverShaderFlags ^= ShadowReceiverShader::Flag::Clipmap;
+        setReceiverShader(_shadowLight.layerCount());
+        Debug() << "Shadow layers:"
+            << (_shadowLight.isClipmapEnabled() ? "scrolling clipmaps, updated incrementally" : "fitted to the view");
+
+    } else if(event.key() == KeyEvent::Key::B) {
+        _shadowReceiverShaderFlags ^= ShadowReceiverShader::Flag::DebugShadowLevels;
+        setReceiverShader(_shadowLight.layerCount());
+        Debug() << "Shadow level tinting:"
+            << (_shadowReceiverShaderFlags & ShadowReceiverShader::Flag::DebugShadowLevels ? "on" : "off");
+
+    } else if(event.key() == KeyEvent::Key::H) {
+        _shadowLight.setBvhEnabled(!_shadowLight.isBvhEnabled());
+        _receiverBvhValid = false;
+        Debug() << "Shadow caster and receiver culling:"
+            << (_shadowLight.isBvhEnabled() ? "bounding volume hierarchy" : "one by one");
+
+    } else if(event.key() == KeyEvent::Key::O) {
+        _sortReceivers = !_sortReceivers;
+        Debug() << "Receiver draw order:"
+            << (_sortReceivers ? "front to back" : "unsorted");
+
+    } else if(event.key() == KeyEvent::Key::P) {
+        _depthPrePass = !_depthPrePass;
+        Debug() << "Receiver depth pre-pass:" << (_depthPrePass ? "on" : "off");
+
+    } else if(event.key() == KeyEvent::Key::T) {
+        Debug() << "Receivers drawn" << _visibleReceivers.size() << "of"
+            << _shadowReceiverDrawables.size() << "shaded samples"
+            << _receiverSamples << (_depthPrePass ? "(with depth pre-pass)" : "(without depth pre-pass)");
+        if(_shadowLight.isClipmapEnabled())
+            Debug() << "Shadow clipmap texels rendered" << _shadowLight.renderedTexelCount();
+        if(_shadowBudgetEnabled)
+            Debug() << "Shadow pass" << _shadowBudget.time() << "ms of" << _shadowBudget.timeBudget()
+                << "ms, configuration" << _shadowBudget.level() + 1 << "of" << _shadowBudget.levelCount();
+        Debug() << "Frame arena peak" << _frameArena.peakSize() << "of" << _frameArena.capacity()
+            << "bytes, heap allocations" << _frameArena.heapAllocationCount();
+        return;
+
+    } else if(event.key() == KeyEvent::Key::N) {
+        _shadowBudgetEnabled = !_shadowBudgetEnabled;
+        if(_shadowBudgetEnabled) applyShadowBudget();
+        Debug() << "Shadow map configuration:"
+            << (_shadowBudgetEnabled ? "adapted to memory and time budget" : "manual");
+
+    } else if(event.key() == KeyEvent::Key::W) {
+        _shadowLight.setWorkerPool(_shadowLight.workerPool() ? nullptr : &_workerPool);
+        if(_shadowLight.workerPool())
+            Debug() << "Shadow layer culling: in parallel on" << _workerPool.threadCount() << "threads";
+        else Debug() << "Shadow layer culling: on the main thread";
+
+    } else if(event.key() == KeyEvent::Key::C) {
+        _shadowLight.setCachingEnabled(!_shadowLight.isCachingEnabled());
+        Debug() << "Shadow map caching:"
+            << (_shadowLight.isCachingEnabled() ? "on" : "off");
+
+    } else if(event.key() == KeyEvent::Key::U) {
+        _shadowLight.setMaxUpdateInterval(_shadowLight.maxUpdateInterval() == 1 ? 16 : 1);
+        Debug() << "Shadow layer update interval: at most"
+            << _shadowLight.maxUpdateInterval() << "frames";
+
     } else return;
 
     event.setAccepted();
@@ -426,8 +895,34 @@ void ShadowsExample::setShadowMapSize(const Vector2i& shadowMapSize) {
     }
 }
 
-void ShadowsExample::recompileReceiverShader(const std::size_t numLayers) {
-    _shadowReceiverShader.reset(new ShadowReceiverShader(numLayers));
+void ShadowsExample::applyShadowBudget() {
+    const ShadowBudget::Configuration& configuration = _shadowBudget.configuration();
+
+    /* Reallocate only if the texture itself changes, the layer scales alone
+       just make the layers render again */
+    const std::size_t layerCount = configuration.layerCount;
+    if(_shadowMapSize != Vector2i{configuration.size} || _shadowLight.layerCount() != layerCount ||
+       _shadowLight.shadowmapFormat() != configuration.format) {
+        const bool layerCountChanged = _shadowLight.layerCount() != layerCount;
+        _shadowMapSize = Vector2i{configuration.size};
+        _shadowLight.setShadowmapFormat(configuration.format);
+        _shadowLight.setupShadowmaps(layerCount, _shadowMapSize);
+        if(layerCountChanged) setReceiverShader(layerCount);
+        _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
+        _evsmFilter.invalidate();
+    }
+
+    for(Int layer = 0; layer != configuration.layerCount; ++layer)
+        _shadowLight.setLayerScale(layer, configuration.layerScale(layer));
+
+    Debug() << "Shadow map size" << _shadowMapSize << "x" << layerCount
+        << "layers, far layers scaled by" << configuration.layerScaleFalloff;
+    Debug() << "Shadow map depth:"
+        << (configuration.format == TextureFormat::DepthComponent16 ? "16-bit" : "driver default");
+}
+
+void ShadowsExample::setReceiverShader(const std::size_t numLayers) {
+    _shadowReceiverShader = &_shadowReceiverShaders.get(numLayers, _shadowReceiverShaderFlags);
     _shadowReceiverShader->setShadowBias(_shadowBias);
     for(std::size_t i = 0; i != _shadowReceiverDrawables.size(); ++i) {
         auto& drawable = static_cast<ShadowReceiverDrawable&>(_shadowReceiverDrawables[i]);
@@ -0,0 +1,203 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SphereCuller.h"
+
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAGNUM_EXAMPLES_SPHERECULLER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace Magnum { namespace Examples {
+
+namespace {
+
+/* All arrays are padded to a multiple of this so the SIMD kernels can run
+   over whole vectors without a remainder, the padding spheres never pass */
+constexpr std::size_t Padding = 8;
+
+}
+
+void SphereCuller::reset(const std::size_t count) {
+    _size = count;
+
+    /* Padding spheres have a hugely negative radius so they never pass */
+    const std::size_t paddedCount = (count + Padding - 1)/Padding*Padding;
+    _x.resize(paddedCount);
+    _y.resize(paddedCount);
+    _z.resize(paddedCount);
+    _r.resize(paddedCount);
+    for(std::size_t i = count; i != paddedCount; ++i) {
+        _x[i] = _y[i] = _z[i] = 0.0f;
+        _r[i] = std::numeric_limits<Float>::lowest();
+    }
+}
+
+Float SphereCuller::cull(const Vector4* const planes, const std::size_t planeCount, const Vector4& depthPlane, Float nearest, const UnsignedInt bit, UnsignedInt* const masks) const {
+    std::size_t i = 0;
+
+    #if defined(__AVX2__) || defined(MAGNUM_EXAMPLES_SPHERECULLER_SSE2) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const std::size_t paddedSize = _r.size();
+    #endif
+
+    #if defined(__AVX2__)
+    __m256 nearest8 = _mm256_set1_ps(nearest);
+    const __m256 infinity8 = _mm256_set1_ps(std::numeric_limits<Float>::max());
+    for(; i != paddedSize; i += 8) {
+        const __m256 x = _mm256_loadu_ps(_x.data() + i);
+        const __m256 y = _mm256_loadu_ps(_y.data() + i);
+        const __m256 z = _mm256_loadu_ps(_z.data() + i);
+        const __m256 r = _mm256_loadu_ps(_r.data() + i);
+
+        /* A sphere is outside if distance + radius < 0 for any plane */
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(std::size_t p = 0; p != planeCount; ++p) {
+            const Vector4& plane = planes[p];
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x())), _mm256_set1_ps(plane.w()));
+            d = _mm256_add_ps(d, _mm256_mul_ps(y, _mm256_set1_ps(plane.y())));
+            d = _mm256_add_ps(d, _mm256_mul_ps(z, _mm256_set1_ps(plane.z())));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        const int insideMask = _mm256_movemask_ps(inside);
+        if(!insideMask) continue;
+
+        __m256 depth = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(depthPlane.x())), _mm256_set1_ps(depthPlane.w()));
+        depth = _mm256_add_ps(depth, _mm256_mul_ps(y, _mm256_set1_ps(depthPlane.y())));
+        depth = _mm256_add_ps(depth, _mm256_mul_ps(z, _mm256_set1_ps(depthPlane.z())));
+        const __m256 nearestPoint = _mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), depth), r);
+        nearest8 = _mm256_min_ps(nearest8, _mm256_blendv_ps(infinity8, nearestPoint, inside));
+
+        for(int lane = 0; lane != 8; ++lane)
+            if(insideMask & (1 << lane)) masks[i + lane] |= bit;
+    }
+
+    alignas(32) Float nearestLanes[8];
+    _mm256_store_ps(nearestLanes, nearest8);
+    for(Float n: nearestLanes) nearest = Math::min(nearest, n);
+
+    #elif defined(MAGNUM_EXAMPLES_SPHERECULLER_SSE2)
+    __m128 nearest4 = _mm_set1_ps(nearest);
+    const __m128 infinity4 = _mm_set1_ps(std::numeric_limits<Float>::max());
+    for(; i != paddedSize; i += 4) {
+        const __m128 x = _mm_loadu_ps(_x.data() + i);
+        const __m128 y = _mm_loadu_ps(_y.data() + i);
+        const __m128 z = _mm_loadu_ps(_z.data() + i);
+        const __m128 r = _mm_loadu_ps(_r.data() + i);
+
+        /* A sphere is outside if distance + radius < 0 for any plane */
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(std::size_t p = 0; p != planeCount; ++p) {
+            const Vector4& plane = planes[p];
+            __m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x())), _mm_set1_ps(plane.w()));
+            d = _mm_add_ps(d, _mm_mul_ps(y, _mm_set1_ps(plane.y())));
+            d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(plane.z())));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+
+        const int insideMask = _mm_movemask_ps(inside);
+        if(!insideMask) continue;
+
+        __m128 depth = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(depthPlane.x())), _mm_set1_ps(depthPlane.w()));
+        depth = _mm_add_ps(depth, _mm_mul_ps(y, _mm_set1_ps(depthPlane.y())));
+        depth = _mm_add_ps(depth, _mm_mul_ps(z, _mm_set1_ps(depthPlane.z())));
+        const __m128 nearestPoint = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), depth), r);
+        /* No blendv in SSE2, select with and/andnot */
+        nearest4 = _mm_min_ps(nearest4, _mm_or_ps(_mm_and_ps(inside, nearestPoint), _mm_andnot_ps(inside, infinity4)));
+
+        for(int lane = 0; lane != 4; ++lane)
+            if(insideMask & (1 << lane)) masks[i + lane] |= bit;
+    }
+
+    alignas(16) Float nearestLanes[4];
+    _mm_store_ps(nearestLanes, nearest4);
+    for(Float n: nearestLanes) nearest = Math::min(nearest, n);
+
+    #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    float32x4_t nearest4 = vdupq_n_f32(nearest);
+    const float32x4_t infinity4 = vdupq_n_f32(std::numeric_limits<Float>::max());
+    for(; i != paddedSize; i += 4) {
+        const float32x4_t x = vld1q_f32(_x.data() + i);
+        const float32x4_t y = vld1q_f32(_y.data() + i);
+        const float32x4_t z = vld1q_f32(_z.data() + i);
+        const float32x4_t r = vld1q_f32(_r.data() + i);
+
+        /* A sphere is outside if distance + radius < 0 for any plane */
+        uint32x4_t inside = vdupq_n_u32(0xffffffffu);
+        for(std::size_t p = 0; p != planeCount; ++p) {
+            const Vector4& plane = planes[p];
+            float32x4_t d = vmlaq_n_f32(vdupq_n_f32(plane.w()), x, plane.x());
+            d = vmlaq_n_f32(d, y, plane.y());
+            d = vmlaq_n_f32(d, z, plane.z());
+            inside = vandq_u32(inside, vcgeq_f32(vaddq_f32(d, r), vdupq_n_f32(0.0f)));
+        }
+
+        UnsignedInt insideLanes[4];
+        vst1q_u32(insideLanes, inside);
+        if(!(insideLanes[0]|insideLanes[1]|insideLanes[2]|insideLanes[3])) continue;
+
+        float32x4_t depth = vmlaq_n_f32(vdupq_n_f32(depthPlane.w()), x, depthPlane.x());
+        depth = vmlaq_n_f32(depth, y, depthPlane.y());
+        depth = vmlaq_n_f32(depth, z, depthPlane.z());
+        const float32x4_t nearestPoint = vsubq_f32(vnegq_f32(depth), r);
+        nearest4 = vminq_f32(nearest4, vbslq_f32(inside, nearestPoint, infinity4));
+
+        for(int lane = 0; lane != 4; ++lane)
+            if(insideLanes[lane]) masks[i + lane] |= bit;
+    }
+
+    Float nearestLanes[4];
+    vst1q_f32(nearestLanes, nearest4);
+    for(Float n: nearestLanes) nearest = Math::min(nearest, n);
+    #endif
+
+    /* Scalar fallback, the SIMD kernels went through everything already */
+    for(; i < _size; ++i) {
+        const Vector4 centre{_x[i], _y[i], _z[i], 1.0f};
+
+        for(std::size_t p = 0; p != planeCount; ++p)
+            if(Math::dot(planes[p], centre) < -_r[i]) goto next;
+
+        nearest = Math::min(nearest, -Math::dot(depthPlane, centre) - _r[i]);
+        masks[i] |= bit;
+
+        next:;
+    }
+
+    return nearest;
+}
+
+}}
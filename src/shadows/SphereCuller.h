@@ -0,0 +1,90 @@
+#ifndef Magnum_Examples_SphereCuller_h
+#define Magnum_Examples_SphereCuller_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <vector>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector4.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Packed structure-of-arrays store of bounding spheres
+
+Centres and radii are kept in separate arrays so the culling kernel can test
+several spheres against a plane at once. AVX2, SSE2 and NEON are used if the
+compiler targets them, otherwise a scalar fallback is used.
+*/
+class SphereCuller {
+    public:
+        /**
+         * @brief Resize the store
+         *
+         * Contents of the spheres are undefined until @ref set() is called
+         * for each of them.
+         */
+        void reset(std::size_t count);
+
+        /** @brief Sphere count */
+        std::size_t size() const { return _size; }
+
+        /** @brief Set sphere centre and radius */
+        void set(std::size_t i, const Vector3& centre, Float radius) {
+            _x[i] = centre.x();
+            _y[i] = centre.y();
+            _z[i] = centre.z();
+            _r[i] = radius;
+        }
+
+        /**
+         * @brief Cull the spheres against a set of planes
+         * @param planes        Normalized planes, positive side is inside
+         * @param planeCount    Plane count
+         * @param depthPlane    Plane to measure depth of the spheres with
+         * @param nearest       Initial nearest depth
+         * @param bit           Bit to set for every sphere that passed
+         * @param masks         Masks to set the bit in, one for each sphere
+         * @return Minimum of @p nearest and `-dot(depthPlane, centre) - radius`
+         *      over all spheres that passed
+         *
+         * A sphere passes if it's not completely on the negative side of any
+         * of the planes.
+         */
+        Float cull(const Vector4* planes, std::size_t planeCount, const Vector4& depthPlane, Float nearest, UnsignedInt bit, UnsignedInt* masks) const;
+
+    private:
+        std::size_t _size{};
+        std::vector<Float> _x, _y, _z, _r;
+};
+
+}}
+
+#endif
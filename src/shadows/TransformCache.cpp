@@ -0,0 +1,98 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TransformCache.h"
+
+#include <Magnum/SceneGraph/MatrixTransformation3D.h>
+#include <Magnum/SceneGraph/Object.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MAGNUM_EXAMPLES_TRANSFORMCACHE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace Magnum { namespace Examples {
+
+namespace {
+
+/* Column-major 4x4 multiplication, each column of the result is a linear
+   combination of the columns of a */
+inline void multiply(const Matrix4& a, const Matrix4& b, Matrix4& out) {
+    #ifdef MAGNUM_EXAMPLES_TRANSFORMCACHE_SSE
+    const Float* const aData = a.data();
+    const Float* const bData = b.data();
+    const __m128 a0 = _mm_loadu_ps(aData + 0);
+    const __m128 a1 = _mm_loadu_ps(aData + 4);
+    const __m128 a2 = _mm_loadu_ps(aData + 8);
+    const __m128 a3 = _mm_loadu_ps(aData + 12);
+    for(std::size_t col = 0; col != 4; ++col) {
+        const Float* const bCol = bData + col*4;
+        __m128 result = _mm_mul_ps(a0, _mm_set1_ps(bCol[0]));
+        result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(bCol[1])));
+        result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(bCol[2])));
+        result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(bCol[3])));
+        _mm_storeu_ps(out.data() + col*4, result);
+    }
+    #else
+    out = a*b;
+    #endif
+}
+
+}
+
+UnsignedInt TransformCache::add(Object3D& object) {
+    const auto found = _indices.find(&object);
+    if(found != _indices.end()) return found->second;
+
+    /* Parents have to come first. The scene itself isn't in the cache, its
+       transformation is always identity. */
+    Int parent = -1;
+    Object3D* const parentObject = object.parent();
+    if(parentObject && !parentObject->isScene())
+        parent = Int(add(*parentObject));
+
+    const UnsignedInt index = UnsignedInt(_objects.size());
+    _objects.push_back(&object);
+    _parents.push_back(parent);
+    _transformations.emplace_back();
+    _indices.emplace(&object, index);
+    return index;
+}
+
+void TransformCache::update() {
+    for(std::size_t i = 0; i != _objects.size(); ++i) {
+        if(_parents[i] == -1)
+            _transformations[i] = _objects[i]->transformationMatrix();
+        else
+            multiply(_transformations[_parents[i]], _objects[i]->transformationMatrix(), _transformations[i]);
+    }
+}
+
+}}
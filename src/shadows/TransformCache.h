@@ -0,0 +1,86 @@
+#ifndef Magnum_Examples_TransformCache_h
+#define Magnum_Examples_TransformCache_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <unordered_map>
+#include <vector>
+#include <Magnum/Math/Matrix4.h>
+
+#include "Types.h"
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Per-frame cache of world transformations
+
+Objects are kept in a flat array ordered so parents always come before their
+children. @ref update() then computes world transformations of all of them in
+a single linear pass, multiplying each local transformation with the already
+computed world transformation of its parent, so both the shadow and the main
+pass can share the result instead of walking the scene graph separately.
+*/
+class TransformCache {
+    public:
+        /**
+         * @brief Add an object
+         *
+         * Parents of the object that aren't in the cache yet are added
+         * too. Returns index of the object. Adding an object that's already
+         * in the cache just returns its index.
+         */
+        UnsignedInt add(Object3D& object);
+
+        /** @brief Object count */
+        std::size_t size() const { return _objects.size(); }
+
+        /** @brief Compute world transformations of all objects */
+        void update();
+
+        /**
+         * @brief World transformation of given object
+         *
+         * Valid after the last @ref update().
+         */
+        const Matrix4& operator[](UnsignedInt index) const {
+            return _transformations[index];
+        }
+
+    private:
+        std::vector<Object3D*> _objects;
+        /* -1 if parent is the scene */
+        std::vector<Int> _parents;
+        std::vector<Matrix4> _transformations;
+        std::unordered_map<Object3D*, UnsignedInt> _indices;
+};
+
+}}
+
+#endif
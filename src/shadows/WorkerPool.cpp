@@ -0,0 +1,114 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "WorkerPool.h"
+
+namespace Magnum { namespace Examples {
+
+WorkerPool::WorkerPool(const std::size_t workerCount) {
+    _workers.reserve(workerCount);
+    for(std::size_t i = 0; i != workerCount; ++i)
+        _workers.emplace_back(&WorkerPool::work, this, i + 1);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _stopping = true;
+    }
+    _started.notify_all();
+    for(std::thread& worker: _workers) worker.join();
+}
+
+void WorkerPool::run(const std::size_t count, const Job& job) {
+    if(!count) return;
+
+    /* Not worth waking anybody up */
+    if(_workers.empty() || count == 1) {
+        for(std::size_t i = 0; i != count; ++i) job(i, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _job = &job;
+        _count = count;
+        _next = 0;
+        _remaining = count;
+        ++_generation;
+    }
+    _started.notify_all();
+
+    runJobs(0);
+
+    std::unique_lock<std::mutex> lock{_mutex};
+    _finished.wait(lock, [&]{ return !_remaining; });
+    _job = nullptr;
+}
+
+void WorkerPool::work(const std::size_t thread) {
+    std::size_t generation = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _started.wait(lock, [&]{ return _stopping || _generation != generation; });
+            if(_stopping) return;
+            generation = _generation;
+        }
+
+        runJobs(thread);
+    }
+}
+
+void WorkerPool::runJobs(const std::size_t thread) {
+    /* Jobs are coarse (a cascade each), so handing them out under the lock
+       is cheap enough */
+    for(;;) {
+        const Job* job;
+        std::size_t index;
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            if(_next == _count) return;
+            job = _job;
+            index = _next++;
+        }
+
+        (*job)(index, thread);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            last = !--_remaining;
+        }
+        if(last) _finished.notify_one();
+    }
+}
+
+}}
@@ -0,0 +1,101 @@
+#ifndef Magnum_Examples_WorkerPool_h
+#define Magnum_Examples_WorkerPool_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016 —
+            Vladimír Vondruš <mosra@centrum.cz>
+        2016 — Bill Robinson <airbaggins@gmail.com>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Pool of worker threads for independent jobs
+
+The calling thread takes part in the work, so a pool with no workers runs
+everything serially. Jobs get the index of the thread running them, which
+can be used to pick per-thread scratch memory without any locking.
+*/
+class WorkerPool {
+    public:
+        /**
+         * @brief Job function
+         *
+         * Called with job index and index of the thread it runs on, which is
+         * less than @ref threadCount().
+         */
+        typedef std::function<void(std::size_t, std::size_t)> Job;
+
+        /**
+         * @brief Constructor
+         * @param workerCount   Count of worker threads in addition to the
+         *      calling thread
+         */
+        explicit WorkerPool(std::size_t workerCount = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() - 1 : 0);
+
+        /** @brief Copying is not allowed */
+        WorkerPool(const WorkerPool&) = delete;
+
+        /** @brief Stops and joins the workers */
+        ~WorkerPool();
+
+        /** @brief Copying is not allowed */
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        /** @brief Count of threads including the calling one */
+        std::size_t threadCount() const { return _workers.size() + 1; }
+
+        /**
+         * @brief Run jobs
+         *
+         * Calls @p job for all indices up to @p count on the workers and the
+         * calling thread and waits until they all finish. Not reentrant.
+         */
+        void run(std::size_t count, const Job& job);
+
+    private:
+        void work(std::size_t thread);
+        void runJobs(std::size_t thread);
+
+        std::vector<std::thread> _workers;
+        std::mutex _mutex;
+        std::condition_variable _started, _finished;
+
+        /* Guarded by the mutex */
+        const Job* _job{};
+        std::size_t _count{}, _next{}, _remaining{}, _generation{};
+        bool _stopping{};
+};
+
+}}
+
+#endif